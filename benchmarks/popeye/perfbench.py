@@ -0,0 +1,196 @@
+#!/usr/bin/env python3
+#
+#  Popeye lifts protocol source code in C to its specification in BNF
+#  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU Affero General Public License as published
+#  by the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU Affero General Public License for more details.
+#
+#  You should have received a copy of the GNU Affero General Public License
+#  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+
+# Runs every protocol of the regression several times with -popeye-profile, collects the timings of the steps, the
+# peak rss, the number of solver calls, and the sizes of the slices, the trees and the bnf into a json file, and
+# compares them against a baseline. It exits with 1 if a run fails its oracle, if any time or rss grows beyond its
+# threshold, or if any count changes in either direction, as a smaller bnf is as suspicious as a larger one.
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import time
+
+# the same protocols and options as regression.sh: (bitcode, entry, options)
+PROTOCOLS = [
+    ("apdu", "popeye_main_apdu", ["-popeye-enable-length-solution=false", "-popeye-oracle-production-num=19",
+                                  "-popeye-oracle-assertion-num=48"]),
+    ("smp", "popeye_main_smp", ["-popeye-oracle-production-num=25", "-popeye-oracle-assertion-num=96"]),
+    ("ssq", "popeye_main_ssq", ["-popeye-enable-loop-summary", "-popeye-oracle-production-num=120",
+                                "-popeye-oracle-assertion-num=741"]),
+    ("l2cap", "popeye_main_l2cap", []),
+    ("osdp", "popeye_main_osdp", []),
+    ("tcp", "popeye_main_ethernet_ip4_tcp", ["-popeye-enable-global"]),
+    ("igmp", "popeye_main_ethernet_ip4_igmp", ["-popeye-enable-global"]),
+    ("quic", "popeye_main_hd_long", []),
+    ("babel", "popeye_main_babel", []),
+    ("isis", "popeye_main_isis", []),
+]
+
+TIME, RSS, COUNT = "time", "rss", "count"
+
+
+def collect(profile, elapsed):
+    """flatten a profile into metric -> (kind, value)"""
+    metrics = {"total_ms": (TIME, round(elapsed * 1000.0, 1)), "peak_rss_kb": (RSS, profile.get("peak_rss_kb", 0))}
+    solver_calls = 0
+    stack = list(profile.get("profile", []))
+    while stack:
+        node = stack.pop()
+        if node["cat"] == "step":
+            # e.g., "Step 1: Abstract interpreting the code" -> step1_ms, and the whole analysis -> analysis_ms
+            name = node["name"].split(":")[0].lower().replace(" ", "") if ":" in node["name"] else "analysis"
+            metrics[name + "_ms"] = (TIME, round(node["wall_us"] / 1000.0, 1))
+        elif node["cat"] == "z3" and node["name"] == "check":
+            solver_calls += node["count"]
+        stack.extend(node["children"])
+    metrics["solver_calls"] = (COUNT, solver_calls)
+    for name, value in profile.get("counters", {}).items():
+        metrics[name] = (COUNT, value)
+    return metrics
+
+
+def run(args, proj, entry, options):
+    bc = os.path.join(args.bc_dir, proj + ".bc")
+    runs = []
+    for i in range(args.runs):
+        prefix = os.path.join(args.out_dir, "%s.%d" % (proj, i))
+        cmd = [args.popeye, bc, "-popeye-entry=" + entry] + options + args.extra + [
+            "-popeye-output=bnf:" + prefix + ".bnf", "-popeye-profile=" + prefix + ".profile.json"]
+        begin = time.monotonic()
+        with open(prefix + ".log", "w") as log:
+            retcode = subprocess.call(cmd, stdout=log, stderr=subprocess.STDOUT)
+        elapsed = time.monotonic() - begin
+        if retcode != 0:
+            print("[INFO] %8s: run %d fails with %d, see %s.log" % (proj, i, retcode, prefix))
+            return None
+        with open(prefix + ".bnf") as f:
+            if "Test failed" in f.read():
+                print("[INFO] %8s: run %d fails the oracle, see %s.bnf" % (proj, i, prefix))
+                return None
+        with open(prefix + ".profile.json") as f:
+            runs.append(collect(json.load(f), elapsed))
+
+    # the median of every metric over the runs
+    result = {}
+    for name, (kind, _) in runs[0].items():
+        values = [r[name][1] for r in runs if name in r]
+        result[name] = {"kind": kind, "median": statistics.median(values), "min": min(values), "max": max(values)}
+    print("[INFO] %8s: %d runs, %.0fms, %dkb, %d solver calls" % (
+        proj, args.runs, result["total_ms"]["median"], result["peak_rss_kb"]["median"],
+        result["solver_calls"]["median"]))
+    return result
+
+
+def compare(args, results, baseline):
+    thresholds = {TIME: (args.time_threshold, args.time_slack), RSS: (args.rss_threshold, args.rss_slack),
+                  COUNT: (args.count_threshold, 0)}
+    regressions = 0
+    for proj, metrics in sorted(results.items()):
+        if proj not in baseline:
+            print("[INFO] %8s: not in the baseline" % proj)
+            continue
+        for name, metric in sorted(metrics.items()):
+            if name not in baseline[proj]:
+                continue
+            old, new = baseline[proj][name]["median"], metric["median"]
+            ratio, slack = thresholds[metric["kind"]]
+            # a change is ignored unless it is beyond both the relative and the absolute thresholds
+            grown = new > old * (1 + ratio) and new - old > slack
+            shrunk = new < old * (1 - ratio) and old - new > slack
+            if not grown and not shrunk:
+                continue
+            if metric["kind"] == COUNT:
+                # the output may have lost productions, so a count must not change without updating the baseline
+                status = "CHANGED"
+                regressions += 1
+            elif grown:
+                status = "REGRESSED"
+                regressions += 1
+            else:
+                status = "improved"
+            print("[INFO] %8s: %-18s %12.1f -> %12.1f %s" % (proj, name, old, new, status))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="benchmark popeye and compare against a baseline")
+    parser.add_argument("popeye")
+    parser.add_argument("bc_dir")
+    parser.add_argument("out_dir")
+    parser.add_argument("--runs", type=int, default=3, help="the number of runs of each protocol")
+    parser.add_argument("--baseline", default="", help="the baseline json to compare against")
+    parser.add_argument("--update-baseline", action="store_true", help="write the results to the baseline")
+    parser.add_argument("--time-threshold", type=float, default=0.25, help="the allowed relative growth of time")
+    parser.add_argument("--time-slack", type=float, default=50, help="the allowed absolute growth of time in ms")
+    parser.add_argument("--rss-threshold", type=float, default=0.15, help="the allowed relative growth of rss")
+    parser.add_argument("--rss-slack", type=float, default=8192, help="the allowed absolute growth of rss in kb")
+    parser.add_argument("--count-threshold", type=float, default=0.0,
+                        help="the allowed relative change of solver calls and slice, tree, and bnf sizes")
+    parser.add_argument("--only", default="", help="a comma-separated list of protocols to run")
+    # the options after -- are passed to popeye
+    argv = sys.argv[1:]
+    split = argv.index("--") if "--" in argv else len(argv)
+    args = parser.parse_args(argv[:split])
+    args.extra = argv[split + 1:]
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    only = set(filter(None, args.only.split(",")))
+    print("[INFO] ----------------------------------------------------")
+    print("[INFO] Perfbench begins")
+    print("[INFO] ----------------------------------------------------")
+    results = {}
+    failures = 0
+    for proj, entry, options in PROTOCOLS:
+        if only and proj not in only:
+            continue
+        if not os.path.isfile(os.path.join(args.bc_dir, proj + ".bc")):
+            print("[INFO] %8s: not found.  Skip!" % proj)
+            continue
+        result = run(args, proj, entry, options)
+        if result is None:
+            failures += 1
+        else:
+            results[proj] = result
+
+    output = os.path.join(args.out_dir, "perfbench.json")
+    with open(output, "w") as f:
+        json.dump(results, f, indent=1, sort_keys=True)
+    print("[INFO] Results written to " + output)
+
+    regressions = 0
+    if args.baseline and args.update_baseline:
+        with open(args.baseline, "w") as f:
+            json.dump(results, f, indent=1, sort_keys=True)
+            f.write("\n")
+        print("[INFO] Baseline updated: " + args.baseline)
+    elif args.baseline and os.path.isfile(args.baseline):
+        with open(args.baseline) as f:
+            regressions = compare(args, results, json.load(f))
+    print("[INFO] ----------------------------------------------------")
+    print("[INFO] Perfbench completes: %d failures, %d regressions" % (failures, regressions))
+    print("[INFO] ----------------------------------------------------")
+    return 1 if failures or regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
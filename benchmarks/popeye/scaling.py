@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+#
+#  Popeye lifts protocol source code in C to its specification in BNF
+#  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU Affero General Public License as published
+#  by the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU Affero General Public License for more details.
+#
+#  You should have received a copy of the GNU Affero General Public License
+#  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+
+# Generates synthetic parsers by popeye-gen, sweeping one dimension at a time while the others keep their defaults,
+# runs popeye on each of them, and writes the time and the memory against each dimension to scaling.json and
+# scaling-<dimension>.csv. The curves are plotted to scaling-<dimension>.png if matplotlib is available.
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import time
+
+sys.dont_write_bytecode = True  # keep the source tree clean
+from perfbench import collect
+
+# dimension -> the values swept, the defaults of popeye-gen are used for the dimensions not swept
+DIMENSIONS = {
+    "fields": [1, 2, 4, 8, 16, 32],
+    "field-width": [1, 2, 4, 8],
+    "length-prefixed": [0, 1, 2, 4, 8],
+    "payload-length": [0, 1, 4, 16, 64],
+    "switch-cases": [1, 2, 4, 8, 16],
+    "depth": [0, 1, 2, 3, 4],
+    "tlv-loops": [0, 1, 2, 4, 8],
+}
+
+METRICS = ["total_ms", "step1_ms", "step2_ms", "step3_ms", "peak_rss_kb", "bnf.productions", "bnf.assertions"]
+
+
+def run(args, dimension, value):
+    prefix = os.path.join(args.out_dir, "%s-%d" % (dimension, value))
+    if subprocess.call([args.popeye_gen, "-%s=%d" % (dimension, value), "-o", prefix + ".bc"]) != 0:
+        return None
+    cmd = [args.popeye, prefix + ".bc", "-popeye-entry=popeye_main_gen", "-popeye-output=bnf:" + prefix + ".bnf",
+           "-popeye-profile=" + prefix + ".profile.json"] + args.extra
+    begin = time.monotonic()
+    try:
+        with open(prefix + ".log", "w") as log:
+            retcode = subprocess.call(cmd, stdout=log, stderr=subprocess.STDOUT, timeout=args.timeout)
+    except subprocess.TimeoutExpired:
+        print("[INFO] %16s = %-3d times out after %ds" % (dimension, value, args.timeout))
+        return None
+    if retcode != 0:
+        print("[INFO] %16s = %-3d fails with %d, see %s.log" % (dimension, value, retcode, prefix))
+        return None
+    with open(prefix + ".profile.json") as f:
+        metrics = collect(json.load(f), time.monotonic() - begin)
+    result = {name: metrics[name][1] for name in METRICS if name in metrics}
+    print("[INFO] %16s = %-3d takes %8.0fms, %8dkb, %5d productions" % (
+        dimension, value, result["total_ms"], result["peak_rss_kb"], result.get("bnf.productions", 0)))
+    return result
+
+
+def plot(args, dimension, points):
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        return False
+    fig, time_axis = plt.subplots()
+    xs = [p["value"] for p in points]
+    time_axis.plot(xs, [p["total_ms"] for p in points], "o-", color="tab:blue")
+    time_axis.set_xlabel(dimension)
+    time_axis.set_ylabel("time (ms)", color="tab:blue")
+    rss_axis = time_axis.twinx()
+    rss_axis.plot(xs, [p["peak_rss_kb"] / 1024.0 for p in points], "s--", color="tab:red")
+    rss_axis.set_ylabel("peak rss (mb)", color="tab:red")
+    fig.tight_layout()
+    fig.savefig(os.path.join(args.out_dir, "scaling-%s.png" % dimension))
+    plt.close(fig)
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="measure how popeye scales on synthetic parsers")
+    parser.add_argument("popeye")
+    parser.add_argument("popeye_gen")
+    parser.add_argument("out_dir")
+    parser.add_argument("--timeout", type=int, default=600, help="the time limit of each run in seconds")
+    parser.add_argument("--only", default="", help="a comma-separated list of dimensions to sweep")
+    # the options after -- are passed to popeye
+    argv = sys.argv[1:]
+    split = argv.index("--") if "--" in argv else len(argv)
+    args = parser.parse_args(argv[:split])
+    args.extra = argv[split + 1:]
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    only = set(filter(None, args.only.split(",")))
+    print("[INFO] ----------------------------------------------------")
+    print("[INFO] Scaling begins")
+    print("[INFO] ----------------------------------------------------")
+    results = {}
+    plotted = True
+    for dimension, values in DIMENSIONS.items():
+        if only and dimension not in only:
+            continue
+        points = []
+        for value in values:
+            result = run(args, dimension, value)
+            if result is None:
+                break  # larger values only take longer
+            result["value"] = value
+            points.append(result)
+        results[dimension] = points
+        with open(os.path.join(args.out_dir, "scaling-%s.csv" % dimension), "w") as f:
+            f.write(",".join([dimension] + METRICS) + "\n")
+            for p in points:
+                f.write(",".join(str(p.get(name, "")) for name in ["value"] + METRICS) + "\n")
+        plotted = plot(args, dimension, points) and plotted
+
+    output = os.path.join(args.out_dir, "scaling.json")
+    with open(output, "w") as f:
+        json.dump(results, f, indent=1, sort_keys=True)
+    print("[INFO] Results written to " + output)
+    if not plotted:
+        print("[INFO] matplotlib is not found, only csv files are written")
+    print("[INFO] ----------------------------------------------------")
+    print("[INFO] Scaling completes")
+    print("[INFO] ----------------------------------------------------")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
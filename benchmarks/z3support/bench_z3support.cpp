@@ -0,0 +1,184 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <benchmark/benchmark.h>
+#include <llvm/Support/CommandLine.h>
+#include <cstring>
+#include <vector>
+#include "Support/Z3.h"
+
+/// Microbenchmarks of the kernels of the z3 facade. The expressions mimic what the lifting builds for a parser, i.e.,
+/// bytes of the message B[i], offsets like pos + B[i], bounds checks like offset <= len, and phis merging offsets.
+
+/// B[I]
+static z3::expr byteAt(unsigned I) {
+    return Z3::byte_array_element(Z3::byte_array(), (int) I);
+}
+
+/// the offset after a length-prefixed field at I, i.e., I + 1 + zext(B[I])
+static z3::expr offsetAt(unsigned I) {
+    return Z3::add(Z3::bv_val(I + 1, 64), Z3::zext(byteAt(I), 64));
+}
+
+/// the bounds checks and the field checks of a message with N fields
+static z3::expr_vector conjuncts(unsigned N) {
+    auto Vec = Z3::vec();
+    for (unsigned I = 0; I < N; ++I) {
+        Vec.push_back(Z3::ule(offsetAt(I), Z3::length(64)));
+        Vec.push_back(I % 2 ? Z3::ne(byteAt(I), Z3::bv_val(0, 8)) : Z3::ult(byteAt(I), Z3::bv_val(I % 64 + 16, 8)));
+    }
+    return Vec;
+}
+
+/// a chain of N phis, each merging the offset of the previous one advanced by a field or not, the phi IDs start from 1.
+/// the previous phi occurs in both arguments, so the chain is a dag whose tree unfolding grows as 2^N
+static z3::expr phiChain(unsigned N) {
+    auto Offset = Z3::bv_val(0, 64);
+    for (unsigned I = 1; I <= N; ++I) {
+        auto Cond = Z3::eq(byteAt(I), Z3::bv_val(I, 8));
+        auto ValVec = Z3::vec();
+        ValVec.push_back(Z3::add(Offset, Z3::zext(byteAt(I), 64)));
+        ValVec.push_back(Z3::add(Offset, 1));
+        auto CondVec = Z3::vec();
+        CondVec.push_back(Cond);
+        CondVec.push_back(Z3::negation(Cond));
+        Offset = Z3::make_phi(I, ValVec, CondVec);
+    }
+    return Offset;
+}
+
+/// a nest of N ites selecting an offset by the type bytes, a dag like the phi chain
+static z3::expr iteChain(unsigned N) {
+    auto Offset = Z3::bv_val(0, 64);
+    for (unsigned I = 1; I <= N; ++I) {
+        auto Cond = Z3::eq(byteAt(0), Z3::bv_val(I, 8));
+        Offset = Z3::ite(Cond, Z3::add(Offset, Z3::zext(byteAt(I), 64)), Z3::add(Offset, (int) I));
+    }
+    return Offset;
+}
+
+/// B[0] ++ B[1] ++ ... ++ B[N - 1]
+static z3::expr byteConcat(unsigned N) {
+    std::vector<z3::expr> Bytes;
+    for (unsigned I = 0; I < N; ++I) Bytes.push_back(byteAt(I));
+    return Z3::concat(Bytes);
+}
+
+static void BM_SimplifyConjunction(benchmark::State &State) {
+    auto Vec = conjuncts(State.range(0));
+    for (auto _: State) benchmark::DoNotOptimize(Z3::simplify(Vec));
+    State.SetComplexityN(State.range(0));
+}
+BENCHMARK(BM_SimplifyConjunction)->RangeMultiplier(2)->Range(4, 64)->Complexity();
+
+static void BM_SimplifyPair(benchmark::State &State) {
+    // simplify a bounds check by each of the other checks, as the slicing and the symbolic execution do
+    auto Vec = conjuncts(State.range(0));
+    for (auto _: State) {
+        for (unsigned I = 1; I < Vec.size(); ++I) benchmark::DoNotOptimize(Z3::simplify(Vec[I], Vec[0]));
+    }
+    State.SetItemsProcessed(State.iterations() * (Vec.size() - 1));
+}
+BENCHMARK(BM_SimplifyPair)->RangeMultiplier(4)->Range(4, 256);
+
+static void BM_FindAllPhis(benchmark::State &State) {
+    auto Phi = phiChain(State.range(0));
+    for (auto _: State) benchmark::DoNotOptimize(Z3::find_all(Phi, true, Z3::is_phi));
+}
+BENCHMARK(BM_FindAllPhis)->DenseRange(2, 12, 2);
+
+static void BM_FindConsecutiveOpsConcat(benchmark::State &State) {
+    auto Concat = byteConcat(State.range(0));
+    for (auto _: State) benchmark::DoNotOptimize(Z3::find_consecutive_ops(Concat, Z3_OP_CONCAT));
+    State.SetComplexityN(State.range(0));
+}
+BENCHMARK(BM_FindConsecutiveOpsConcat)->RangeMultiplier(4)->Range(4, 1024)->Complexity();
+
+static void BM_FindConsecutiveOpsAnd(benchmark::State &State) {
+    auto And = Z3::make_and(conjuncts(State.range(0)));
+    for (auto _: State) benchmark::DoNotOptimize(Z3::find_consecutive_ops(And, Z3_OP_AND));
+    State.SetComplexityN(State.range(0));
+}
+BENCHMARK(BM_FindConsecutiveOpsAnd)->RangeMultiplier(4)->Range(4, 1024)->Complexity();
+
+static void BM_MakePhi(benchmark::State &State) {
+    for (auto _: State) benchmark::DoNotOptimize(phiChain(State.range(0)));
+    State.SetItemsProcessed(State.iterations() * State.range(0));
+}
+BENCHMARK(BM_MakePhi)->DenseRange(2, 8, 2);
+
+static void BM_SelectPhiArg(benchmark::State &State) {
+    // select an argument of the phi in the middle of the chain, which rewrites all the phis above it
+    unsigned N = State.range(0);
+    auto Phi = phiChain(N);
+    for (auto _: State) benchmark::DoNotOptimize(Z3::select_phi_arg(N / 2, 0, Phi));
+}
+BENCHMARK(BM_SelectPhiArg)->DenseRange(2, 12, 2);
+
+static void BM_Strlem(benchmark::State &State) {
+    auto Byte = byteAt(7);
+    for (auto _: State) benchmark::DoNotOptimize(Z3::strlem(Byte, 64));
+}
+BENCHMARK(BM_Strlem);
+
+static void BM_IndexLessThan(benchmark::State &State) {
+    // the indices after N strings, e.g., 3 + strlem + k x strlem vs. 4 + k x strlem + strlem
+    auto K = Z3::k();
+    auto Strlem = Z3::strlem(byteAt(0), 64);
+    auto A = Z3::bv_val(3, 64);
+    auto B = Z3::bv_val(4, 64);
+    for (unsigned I = 0; I < State.range(0); ++I) {
+        auto Term = Z3::mul(Z3::bv_val(I + 1, 64), Z3::mul(K, Strlem));
+        A = Z3::add(Z3::add(A, Strlem), Term);
+        B = Z3::add(Term, Z3::add(B, Strlem));
+    }
+    for (auto _: State) benchmark::DoNotOptimize(Z3::byte_array_element_index_less_than(A, B));
+    State.SetComplexityN(State.range(0));
+}
+BENCHMARK(BM_IndexLessThan)->RangeMultiplier(2)->Range(1, 16)->Complexity();
+
+static void BM_ToStringConjunction(benchmark::State &State) {
+    auto And = Z3::make_and(conjuncts(State.range(0)));
+    for (auto _: State) benchmark::DoNotOptimize(Z3::to_string(And));
+    State.SetComplexityN(State.range(0));
+}
+BENCHMARK(BM_ToStringConjunction)->RangeMultiplier(4)->Range(4, 256)->Complexity();
+
+static void BM_ToStringIte(benchmark::State &State) {
+    auto Ite = iteChain(State.range(0));
+    for (auto _: State) benchmark::DoNotOptimize(Z3::to_string(Ite));
+}
+BENCHMARK(BM_ToStringIte)->DenseRange(2, 12, 2);
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+
+    // the remaining arguments are popeye options, the simplify cache is disabled unless specified so that
+    // the kernel rather than the cache is measured
+    std::vector<const char *> Args(argv, argv + argc);
+    bool CacheSpecified = false;
+    for (auto *Arg: Args) CacheSpecified |= strstr(Arg, "popeye-simplify-cache-size") != nullptr;
+    if (!CacheSpecified) Args.push_back("-popeye-simplify-cache-size=0");
+    llvm::cl::ParseCommandLineOptions((int) Args.size(), Args.data(), "Microbenchmarks of the z3 facade\n");
+
+    Z3::initialize();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    Z3::finalize();
+    return 0;
+}
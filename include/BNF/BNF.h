@@ -178,6 +178,9 @@ private:
 
     int getEndianness(Production *P);
 
+    /// the numbers of productions and assertions as printed, counting the epsilon and the vspell productions
+    void count(unsigned &NumProductions, unsigned &NumAssertions) const;
+
     friend raw_ostream &operator<<(llvm::raw_ostream &, const BNF &);
 };
 
@@ -95,6 +95,22 @@ public:
     }
 };
 
+/// the result of comparing two bounds
+enum BoundOrder {
+    BO_Less,
+    BO_Equal,
+    BO_Greater,
+    BO_Incomparable
+};
+
+/// compare two bounds, unlike the comparison operators, it does not throw if they are not comparable
+/// @{
+BoundOrder compare(const Bound &, const Bound &);
+
+BoundOrder compare(const BoundRef &, const BoundRef &);
+/// @}
+
+/// comparison operators throw std::runtime_error if the two bounds are not comparable
 raw_ostream &operator<<(llvm::raw_ostream &, const Bound &);
 
 bool operator==(const Bound &, const Bound &);
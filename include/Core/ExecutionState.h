@@ -28,9 +28,12 @@
 #include "Memory/HeapMemoryBlock.h"
 #include "Memory/MessageBuffer.h"
 #include "Memory/StackMemoryBlock.h"
+#include "Support/Persistent.h"
 
 using namespace llvm;
 
+class FunctionSummary;
+
 class ExecutionState {
 private:
 #ifndef NDEBUG
@@ -41,14 +44,16 @@ private:
     /// @}
 #endif
 
+    /// the containers below are persistent, thus forking a state does not copy them
+
     /// record the path conditions that only relates to message buffer
-    std::vector<z3::expr> PC;
+    PersistentVector<z3::expr> PC;
 
     /// values really used in this state
-    std::map<AbstractValue *, std::shared_ptr<AbstractValue>> AbsValRevisionMap;
+    PersistentMap<AbstractValue *, std::shared_ptr<AbstractValue>> AbsValRevisionMap;
 
     /// named message bytes, use the expr id for efficiency
-    std::set<unsigned> NamedByteSet;
+    PersistentSet<unsigned> NamedByteSet;
 
 public:
     ExecutionState();
@@ -119,7 +124,7 @@ public:
     void markCall();
 
     /// given a byte id, check if it is named or not
-    bool named(unsigned ID) { return NamedByteSet.count(ID); }
+    bool named(unsigned ID);
 
     /// get the branch condition
     z3::expr condition(BasicBlock *B, unsigned I);
@@ -132,6 +137,15 @@ public:
     std::vector<StackMemoryBlock *>::const_iterator stack_mem_end() const;
     /// @}
 
+public:
+    /// record how the states access memory and pc into the summary until the recording stops
+    /// recordings can be nested, i.e., an inner call also contributes to the summaries of its callers
+    /// @{
+    static void startRecording(FunctionSummary *);
+
+    static void stopRecording(FunctionSummary *);
+    /// @}
+
 private:
     void merge(unsigned MergeID,
                const std::map<AbstractValue *, std::vector<std::pair<AbstractValue*, unsigned>>> &,
@@ -143,6 +157,8 @@ private:
 
     friend raw_ostream &operator<<(llvm::raw_ostream &, ExecutionState &);
 
+    friend class FunctionSummary;
+
     bool optimize(std::vector<std::pair<AddressValue *, z3::expr>> &);
 
     std::shared_ptr<AddressValue> optimize2(std::vector<std::pair<AddressValue *, z3::expr>> &, unsigned PhiID);
@@ -29,22 +29,28 @@
 #include "Core/ExecutionState.h"
 #include "Core/LoopSummaryAnalysis.h"
 #include "Core/LoopInformationAnalysis.h"
+#include "Core/MessageTaintAnalysis.h"
 #include "Core/SliceGraph.h"
 #include "Support/InstructionVisitor.h"
 
 using namespace llvm;
 
+struct BlockTable;
+
 class Executor : public InstructionVisitor<Executor> {
 private:
     /// llvm pass that drives this executor
     Pass *DriverPass;
 
-    /// the execution state before entering to a basic block
+    /// the sorted blocks of the function being analyzed, shared by all visits of the function
+    const BlockTable *Blocks = nullptr;
+
+    /// the execution state before entering to a basic block, indexed by the block index in Blocks
     /// a block may have multiple incoming edges, thus multiple incoming states
-    std::map<BasicBlock *, std::vector<ExecutionState *>> StateMap;
+    std::vector<std::vector<ExecutionState *>> StateTable;
 
-    /// block -> { incoming block index -> condition }
-    std::map<BasicBlock *, std::vector<z3::expr>> MergeCondMap;
+    /// block index -> { incoming block index -> condition }
+    std::vector<std::vector<z3::expr>> MergeCondTable;
 
     /// current state
     /// @{
@@ -63,7 +69,6 @@ private:
     /// @{
     unsigned LastProcessingBlockPointer = 0;
     unsigned ProcessingBlockPointer = 0;
-    std::map<SingleLoop *, unsigned> LoopHeaderIdxMap;
     /// @}
 
     /// count the number of merging during the analysis
@@ -72,6 +77,9 @@ private:
 
     /// collect source code level type info
     DistinctMetadataAnalysis *DMA = nullptr;
+
+    /// find calls to functions never touching the message
+    MessageTaintAnalysis *MTA = nullptr;
     static std::map<Value *, DIType *> ValueDebugTypeMap;
 
 public:
@@ -143,8 +151,12 @@ private:
 
     void visitCallIPA(CallInst &I, Function *Callee = nullptr);
 
+    bool visitCallSummary(CallInst &I, Function *Callee, const std::vector<AbstractValue *> &Args);
+
     void visitCallDefault(CallInst &I);
 
+    bool visitCallMessageFree(CallInst &I, Function *Callee);
+
     void visitDbgValue(DbgValueInst &I);
 
     void visitDbgDeclare(DbgDeclareInst &I);
@@ -156,6 +168,8 @@ private:
 
     void load(LoadInst *, AddressValue *, AbstractValue *);
 
+    bool visitLoadConstantTable(LoadInst &I, AbstractValue *Result);
+
     void _load(LoadInst *, AbstractValue *Dst, MemoryBlock *Addr, const z3::expr &Off);
 
     void store(StoreInst *, AddressValue *, AbstractValue *);
@@ -168,6 +182,10 @@ private:
 
     void sortBlocks(Function &F, std::vector<BasicBlock *> &DFSOrderVec);
 
+    const BlockTable *getBlockTable(Function &F);
+
+    unsigned blockIndex(BasicBlock *B) const;
+
     bool compareLength(ICmpInst *I);
 
     void packing(ReturnInst &I);
@@ -0,0 +1,130 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORE_FUNCTIONSUMMARY_H
+#define CORE_FUNCTIONSUMMARY_H
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "Memory/MemoryBlock.h"
+#include "Support/Persistent.h"
+
+class ExecutionState;
+
+/// The footprint of analyzing a callee once. It records the inputs the analysis depends on, i.e., the actual
+/// arguments, the memory read, and the conditions checked against the caller's pc, as well as the effects it has,
+/// i.e., the return value, the memory written, and the pc appended. If a later call has equivalent inputs, the
+/// effects are replayed instead of analyzing the callee again.
+class FunctionSummary {
+private:
+    /// inputs
+    /// @{
+    std::vector<std::shared_ptr<AbstractValue>> ArgVec;
+    std::vector<std::pair<AbstractValue *, std::shared_ptr<AbstractValue>>> ReadVec;
+    std::vector<z3::expr> ConflictCheckVec; // conditions checked against the caller's pc when forking
+    std::vector<z3::expr> SimplifyVec; // conditions simplified against the caller's pc when adding them to pc
+    std::vector<unsigned> UnnamedByteVec; // message bytes that are checked to be not named yet
+    std::vector<unsigned> CallerNamedQueryVec; // message bytes named by the caller and checked to be named
+    /// @}
+
+    /// effects
+    /// @{
+    std::shared_ptr<AbstractValue> RetVal;
+    std::vector<std::pair<AbstractValue *, std::shared_ptr<AbstractValue>>> WriteVec;
+    std::vector<AbstractValue *> EscapedVec; // memory revisions escaping to the caller
+    std::vector<z3::expr> PCVec;
+    std::vector<unsigned> NamedByteVec;
+    /// @}
+
+    /// memory cells and blocks referenced by the summary, the summary is useless after any of them is released
+    /// @{
+    std::set<AbstractValue *> CellSet;
+    std::set<MemoryBlock *> BlockSet;
+    /// @}
+
+    bool Cacheable = true;
+
+    /// states used only when recording
+    /// @{
+    std::vector<unsigned> CallerPC;
+    PersistentSet<unsigned> CallerNamedByteSet;
+    std::set<MemoryBlock *> LocalMemSet;
+    std::set<AbstractValue *> LocalValSet;
+    std::set<AbstractValue *> AccessedValSet;
+    std::set<AbstractValue *> WrittenValSet;
+    std::set<unsigned> UnnamedByteSet;
+    std::set<unsigned> CallerNamedQuerySet;
+    std::set<AbstractValue *> EscapedSet;
+    /// @}
+
+public:
+    /// start recording a call with the actual arguments \p Args at the state \p ES
+    FunctionSummary(ExecutionState *ES, const std::vector<AbstractValue *> &Args);
+
+    /// stop recording after the callee returns \p Ret (nullptr for void) at the state \p ES
+    void finish(ExecutionState *ES, AbstractValue *Ret);
+
+    /// the summary cannot be reused, e.g., the callee stores to the message buffer
+    void invalidate() { Cacheable = false; }
+
+    bool cacheable() const { return Cacheable; }
+
+    /// check if a call with the actual arguments \p Args at the state \p ES has the same inputs as the summary
+    bool match(ExecutionState *ES, const std::vector<AbstractValue *> &Args) const;
+
+    /// apply the effects to the state \p ES, \p Escaped collects the memory revisions escaping to the caller
+    void replay(ExecutionState *ES, AbstractValue *Receiver, std::set<AbstractValue *> &Escaped) const;
+
+    /// check if the summary references any of the released memory cells or blocks
+    bool references(const std::set<MemoryBlock *> &Blocks, const std::set<AbstractValue *> &Cells) const;
+
+public:
+    /// callbacks when recording
+    /// @{
+    void recordAllocation(MemoryBlock *Mem);
+
+    void recordRead(AbstractValue *Key, AbstractValue *Val);
+
+    void recordWrite(AbstractValue *Key);
+
+    /// callback from the executor when the callee returns
+    void recordEscape(AbstractValue *Key);
+
+    /// \p ConflictIdx is the index of the pc conflicting with \p Cond, UINT_MAX if there is none
+    void recordConflictCheck(const z3::expr &Cond, unsigned ConflictIdx);
+
+    /// \p FirstChangeIdx is the index of the first pc that simplifies \p Cond, UINT_MAX if there is none
+    void recordSimplification(const z3::expr &Cond, unsigned FirstChangeIdx);
+
+    /// the byte \p ID is checked to be named or not
+    void recordNamedQuery(unsigned ID, bool Named);
+    /// @}
+
+private:
+    /// check if \p V references any memory allocated during the call, and collect the blocks it references
+    bool escapes(AbstractValue *V);
+
+    /// check if the caller has named the bytes the callee found unnamed, see match()
+    bool renamed(ExecutionState *ES) const;
+
+    static bool equivalent(AbstractValue *V1, AbstractValue *V2);
+};
+
+#endif //CORE_FUNCTIONSUMMARY_H
@@ -0,0 +1,97 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORE_MESSAGETAINTANALYSIS_H
+#define CORE_MESSAGETAINTANALYSIS_H
+
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+/// A flow-insensitive pre-analysis that finds which values may be derived from the message,
+/// i.e., from the return values of popeye_make_message and popeye_make_message_length.
+/// Functions that neither touch such values nor write memory visible to their callers are message-free,
+/// and calls to them can be abstracted away without analyzing the callee.
+class MessageTaintAnalysis : public ModulePass {
+private:
+    /// values that may be derived from the message, or point to memory holding such values
+    DenseSet<Value *> TaintedValues;
+
+    /// memory objects (allocas, globals, allocation calls, pointer arguments) that may hold message-derived data
+    DenseSet<Value *> TaintedObjects;
+
+    /// message-derived data is stored to memory whose base object cannot be identified
+    bool TaintEscaped = false;
+
+    /// functions whose returned values may be derived from the message
+    DenseSet<Function *> TaintedReturns;
+
+    /// globals only used to record statistics, i.e., they are only updated from their own values
+    DenseSet<GlobalVariable *> SinkGlobals;
+
+    /// defined functions that may be called indirectly
+    std::vector<Function *> AddressTakenFunctions;
+
+    /// pointer -> the base objects it may point to
+    mutable DenseMap<Value *, SmallVector<Value *, 2>> ObjectMap;
+
+    std::set<Function *> MessageFreeFunctions;
+
+public:
+    static char ID;
+
+    MessageTaintAnalysis() : ModulePass(ID) {}
+
+    ~MessageTaintAnalysis() override = default;
+
+    void getAnalysisUsage(AnalysisUsage &) const override;
+
+    bool runOnModule(Module &) override;
+
+    /// the function never touches the message and has no side effects visible to its callers
+    bool messageFree(Function *F) const { return MessageFreeFunctions.count(F); }
+
+    /// the call does not need to be analyzed, because neither the callee nor its result matters
+    bool skippable(CallInst &I, Function *Callee) const { return I.use_empty() && messageFree(Callee); }
+
+private:
+    const SmallVectorImpl<Value *> &objects(Value *Ptr) const;
+
+    bool tainted(Value *V) const;
+
+    bool taint(Value *V);
+
+    bool taintObjects(Value *Ptr);
+
+    bool propagate(Instruction &I);
+
+    bool propagateCall(CallInst &I);
+
+    void collectSinkGlobals(Module &M);
+
+    bool locallyMessageFree(Function &F) const;
+
+    bool writesVisibleMemory(Instruction &I, Value *Ptr) const;
+};
+
+#endif //CORE_MESSAGETAINTANALYSIS_H
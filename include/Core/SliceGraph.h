@@ -20,6 +20,7 @@
 #ifndef BNF_SLICEGRAPH_H
 #define BNF_SLICEGRAPH_H
 
+#include <functional>
 #include "Support/Z3.h"
 
 class SliceGraph;
@@ -30,6 +31,8 @@ class SliceGraphNode {
 private:
     /// @{
     z3::expr Condition;
+    /// the expr identifying the node, it is the condition unless the node stands for taking a phi condition
+    z3::expr Identity;
     unsigned ConditionID;
     /// @}
 
@@ -42,15 +45,20 @@ private:
     std::set<SliceGraphNode *> Parents;
 
 public:
-    SliceGraphNode(z3::expr Cond) : Condition(Cond), ConditionID(Z3::id(Cond)), Color(0) {}
+    SliceGraphNode(z3::expr Cond) : Condition(Cond), Identity(Cond), ConditionID(Z3::id(Cond)), Color(0) {}
 
-    z3::expr getCondition() const { return Condition; }
+    const z3::expr &getCondition() const { return Condition; }
 
     void setCondition(const z3::expr &C) { Condition = C; }
 
     unsigned getConditionID() const { return ConditionID; };
 
-    void setConditionID(unsigned ID) { ConditionID = ID; }
+    const z3::expr &getIdentity() const { return Identity; }
+
+    void setConditionID(const z3::expr &E) {
+        Identity = E;
+        ConditionID = Z3::id(E);
+    }
 
     const char *getColor() const { return Color; }
 
@@ -133,6 +141,13 @@ public:
 
     z3::expr_vector collectConstraints(SliceGraphNode *From, std::vector<SliceGraphNode *> &Tos, bool ExFrom) const;
 
+    /// the batched version of the above, the K-th result contains the nodes N reachable from Froms[K] such that
+    /// IsTarget(K, N) holds, in the topological order, each with the constraints from Froms[K] to it
+    /// all sources are handled in a single sweep, sharing the condition lists where they reach a node in the same way
+    std::vector<std::vector<std::pair<SliceGraphNode *, z3::expr>>>
+    collectConstraints(const std::vector<SliceGraphNode *> &Froms,
+                       const std::function<bool(unsigned, SliceGraphNode *)> &IsTarget, bool ExFrom) const;
+
 private:
     z3::expr simplify(const z3::expr &) const;
 
@@ -22,6 +22,7 @@
 #include "Core/SymbolicExecutionTree.h"
 #include "Core/SliceGraph.h"
 #include "Support/PushPop.h"
+#include "Support/WorkStealingPool.h"
 
 using namespace llvm;
 
@@ -34,14 +35,57 @@ struct PhiPointer {
     }
 };
 
+struct SymbolicExecutionTasks;
+struct SymbolicExecutionBudget;
+
 class SymbolicExecution {
 private:
+    /// what the subtree of a graph node reads from the stacks, all sorted
+    struct SubtreeFootprint {
+        /// the phis whose selections matter
+        std::vector<unsigned> PhiIDs;
+        /// the named elements that matter
+        std::vector<unsigned> NamedIDs;
+        /// the atoms of the conditions, a path condition sharing none of them cannot simplify the subtree
+        std::vector<unsigned> Atoms;
+        /// some condition has no atom, so every path condition matters
+        bool Ground = false;
+        /// eliminating a phi may create an atom, thus the footprint is unknown
+        bool Opaque = false;
+    };
+
+    struct MemoizedSubtree {
+        SymbolicExecutionTreeNode *Node;
+        /// the path conditions in the key, kept to pin their ids
+        z3::expr_vector Pins;
+    };
+
+    /// a lazy enumeration of the phi selections of a graph node, see SymbolicExecution.cpp
+    class PhiCombinations;
+
     PushPopSet<PhiPointer> PhiSelectorStack;
+    /// ast id -> the expr without phi, an entry is valid as long as the phi selectors it relies on
+    PushPopMap<unsigned, z3::expr> EliminatePhiMemo;
     PushPopVector<SliceGraphNode *> BNFExecutionPath;
+    /// the phi selectors of each node in the execution path, used to rebuild the stacks in a forked task
+    PushPopVector<const std::vector<PhiPointer> *> PhiSelectorPath;
     PushPopSet<unsigned> NamedElementStack;
     PushPopVector<z3::expr> PathCondStack;
+    /// the atoms of each path condition in PathCondStack, only collected if subtrees are memoized
+    PushPopVector<std::vector<unsigned>> PathCondAtomStack;
     std::map<unsigned, std::vector<unsigned>> PhiID2DupValIDMap;
 
+    std::map<SliceGraphNode *, SubtreeFootprint> FootprintMap;
+    /// (graph node, what its subtree reads from the stacks) -> the explored subtree
+    std::map<std::pair<SliceGraphNode *, std::vector<unsigned>>, MemoizedSubtree> SubtreeMemo;
+    unsigned NumSubtreeShared = 0;
+
+    /// not null if subtrees are explored in parallel, each task works in the z3 context of its worker
+    SymbolicExecutionTasks *Tasks = nullptr;
+
+    /// the time, node and memory budgets of the run, shared by the tasks
+    SymbolicExecutionBudget *Budget = nullptr;
+
 public:
     static char ID;
 
@@ -52,7 +96,32 @@ public:
     SymbolicExecutionTree *run(const z3::expr &, SliceGraph &);
 
 private:
-    void doSymbolicExecutionDFS(SymbolicExecutionTreeNode *, SliceGraphNode *, std::vector<PhiPointer> &);
+    /// return the tree node created for the graph node, which is linked to the parent if the parent is not null
+    SymbolicExecutionTreeNode *doSymbolicExecutionDFS(SymbolicExecutionTreeNode *, SliceGraphNode *,
+                                                      const std::vector<PhiPointer> &);
+
+    /// explore the subtree of the graph node in the current thread, or fork a task exploring it
+    void visit(SymbolicExecutionTreeNode *, SliceGraphNode *, const std::vector<PhiPointer> &);
+
+    const SubtreeFootprint &footprint(SliceGraphNode *);
+
+    /// return false if the subtree of the graph node cannot be memoized
+    bool subtreeKey(SliceGraphNode *, const std::vector<PhiPointer> &, std::vector<unsigned> &, z3::expr_vector &);
+
+    /// push the scopes for the graph node and return its simplified condition
+    z3::expr enter(SliceGraphNode *, const std::vector<PhiPointer> &);
+
+    void leave();
+
+    /// return true if a budget is exhausted, after which no frontier is expanded any more
+    bool exhausted();
+
+    /// the condition of the graph node, and its id, in the z3 context of the current thread
+    /// @{
+    z3::expr condition(SliceGraphNode *);
+
+    unsigned conditionID(SliceGraphNode *);
+    /// @}
 
     z3::expr doSymbolicExecutionSimplify(const z3::expr &);
 
@@ -60,8 +129,12 @@ private:
 
     z3::expr doSymbolicExecutionEliminatePhi(const z3::expr &);
 
+    z3::expr doSymbolicExecutionEliminatePhiNoMemo(const z3::expr &);
+
     z3::expr doSymbolicExecutionEliminateConflict(const z3::expr &);
 
+    bool checkFeasibility(const z3::expr &);
+
     void evaluatePhi(SliceGraphNode *, std::map<unsigned, std::vector<unsigned>> &);
 
     void findDupPhiVal(const z3::expr &);
@@ -21,15 +21,17 @@
 #define CORE_EXECUTIONTREE_H
 
 #include <set>
+#include <unordered_map>
 #include <vector>
 #include "Support/Z3.h"
 
+/// a node may have multiple parents if symbolic execution shares an explored subtree, so the tree is actually a DAG
 class SymbolicExecutionTreeNode {
     friend class SymbolicExecutionTree;
 
 private:
     z3::expr Expr;
-    SymbolicExecutionTreeNode *Parent = nullptr;
+    std::set<SymbolicExecutionTreeNode *> Parents;
     std::set<SymbolicExecutionTreeNode *> Children;
 
 public:
@@ -43,7 +45,7 @@ public:
 
     void addChild(SymbolicExecutionTreeNode *);
 
-    SymbolicExecutionTreeNode *getParent() const { return Parent; }
+    const std::set<SymbolicExecutionTreeNode *> &getParents() const { return Parents; }
 };
 
 class SymbolicExecutionTree {
@@ -68,7 +70,7 @@ private:
 
     void compressSiblings();
 
-    z3::expr pc(SymbolicExecutionTreeNode *) const;
+    z3::expr pc(SymbolicExecutionTreeNode *, std::unordered_map<SymbolicExecutionTreeNode *, z3::expr> &) const;
 
 public:
     template<class ActionAtDFS>
@@ -22,6 +22,7 @@
 #include <llvm/Support/Casting.h>
 #include <z3++.h>
 #include "Support/DL.h"
+#include "Support/SlabPool.h"
 #include "Support/Z3.h"
 
 #define DEFAULT_IMPL {                                                 \
@@ -48,6 +49,8 @@ public:
 
     virtual ~AbstractValue() = 0;
 
+    SLAB_ALLOCATED
+
     AbstractValueKind getKind() const;
 
     StringRef getKindName() const;
@@ -76,7 +79,10 @@ public:
     /// @{
     virtual void set(const z3::expr &) DEFAULT_IMPL
 
-    virtual z3::expr &value() DEFAULT_IMPL
+    /// set a concrete value of at most 64 bits, truncated to the bytewidth
+    virtual void set(uint64_t) DEFAULT_IMPL
+
+    virtual const z3::expr &value() DEFAULT_IMPL
 
     virtual bool int64(int64_t &) DEFAULT_IMPL
 
@@ -99,10 +105,18 @@ public:
     /// @}
 };
 
+/// a scalar keeps a concrete value of at most 64 bits natively, and only creates its z3 form on demand,
+/// so that arithmetic on offsets, lengths and loop counters does not build z3 terms
 class ScalarValue : public AbstractValue {
 private:
+    /// the z3 form of the value, a placeholder if not materialized
     z3::expr Value;
     unsigned Bytewidth;
+    /// the concrete value truncated to the bytewidth, valid if Concrete
+    uint64_t Bits = 0;
+    bool Concrete = false;
+    /// false if the value is concrete and its z3 form has not been created
+    bool Materialized = true;
 
 public:
     explicit ScalarValue(unsigned Bytes) : AbstractValue(AVK_Scalar), Bytewidth(Bytes),
@@ -112,32 +126,64 @@ public:
                                                                 Bytewidth(Bytes), Value(Val) {
         assert(Val.is_bv());
         assert(Val.get_sort().bv_size() == Bytes * 8);
+        classify();
+    }
+
+    explicit ScalarValue(unsigned Bytes, uint64_t Val) : AbstractValue(AVK_Scalar),
+                                                         Bytewidth(Bytes), Value(Z3::bool_val(true)) {
+        set(Val);
     }
 
     ~ScalarValue() override = default;
 
     bool poison() override {
-        return Z3::is_free(Value);
+        return !Concrete && Z3::is_free(Value);
     }
 
     void mkpoison() override {
         Value = Z3::free_bv(Bytewidth * 8);
+        Concrete = false;
+        Materialized = true;
     }
 
     unsigned bytewidth() override {
         return Bytewidth;
     }
 
-    z3::expr &value() override {
+    /// use set() to change the value
+    const z3::expr &value() override {
+        if (!Materialized) {
+            Value = Z3::bv_val(Bits, Bytewidth * 8);
+            Materialized = true;
+        }
         return Value;
     }
 
     void set(const z3::expr &Val) override {
         assert(Bytewidth * 8 == Val.get_sort().bv_size());
         Value = Val;
+        classify();
+    }
+
+    void set(uint64_t Val) override {
+        assert(Bytewidth <= 8 && "Error: a concrete value has at most 64 bits!");
+        Bits = Bytewidth == 8 ? Val : Val & ((1ULL << (Bytewidth * 8)) - 1);
+        Concrete = true;
+        Materialized = false;
+    }
+
+    /// return true and the concrete value if the value is concrete, never creates z3 terms
+    bool concrete(uint64_t &I) const {
+        if (!Concrete) return false;
+        I = Bits;
+        return true;
     }
 
     bool int64(int64_t &I) override {
+        if (Concrete) {
+            I = ((int64_t) (Bits << (64 - Bytewidth * 8))) >> (64 - Bytewidth * 8);
+            return true;
+        }
         if (poison()) return false;
         if (Z3::is_numeral_i64(Value, I)) {
             return true;
@@ -146,6 +192,10 @@ public:
     }
 
     bool uint64(uint64_t &I) override {
+        if (Concrete) {
+            I = Bits;
+            return true;
+        }
         if (poison()) return false;
         if (Value.is_numeral_u64(I)) {
             return true;
@@ -154,7 +204,8 @@ public:
     }
 
     void zeroInitialize() override {
-        Value = Z3::bv_val(0, bytewidth() * 8);
+        if (Bytewidth <= 8) set((uint64_t) 0);
+        else set(Z3::bv_val(0, bytewidth() * 8));
     }
 
     void assign(AbstractValue *) override;
@@ -162,10 +213,18 @@ public:
     std::string str() override;
 
     AbstractValue *clone() override {
+        if (!Materialized) return new ScalarValue(Bytewidth, Bits);
         auto *Ret = new ScalarValue(Bytewidth, Value);
         return Ret;
     }
 
+private:
+    /// a numeral of at most 64 bits becomes concrete
+    void classify() {
+        Materialized = true;
+        Concrete = Bytewidth <= 8 && Value.is_numeral_u64(Bits);
+    }
+
 public:
     static bool classof(const AbstractValue *AV) {
         return AV->getKind() == AVK_Scalar;
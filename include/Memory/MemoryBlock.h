@@ -24,6 +24,7 @@
 #include <cstdio>
 #include <vector>
 #include "Memory/AbstractValue.h"
+#include "Support/SlabPool.h"
 
 class MemoryBlock {
 public:
@@ -44,6 +45,8 @@ public:
 
     virtual ~MemoryBlock();
 
+    SLAB_ALLOCATED
+
     virtual AbstractValue *at(size_t Offset);
 
     virtual AbstractValue *at(const z3::expr &Offset);
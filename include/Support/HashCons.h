@@ -0,0 +1,80 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUPPORT_HASHCONS_H
+#define SUPPORT_HASHCONS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// Assign the same id to structurally equal nodes of a DAG, i.e., nodes with the same label and the same set of
+/// children ids. Nodes are added bottom-up (e.g., in a reversed topological order) so that the ids of their children
+/// are already known. Nodes are bucketed by a 64-bit structural hash and compared exactly within a bucket.
+class HashConsTable {
+private:
+    struct Entry {
+        uint64_t Label;
+        std::vector<unsigned> Children;
+    };
+
+    std::vector<Entry> Entries;
+    std::unordered_map<uint64_t, std::vector<unsigned>> Buckets;
+
+public:
+    /// return the id of the node and whether the id is new, \p Children is sorted and deduplicated in place
+    std::pair<unsigned, bool> insert(uint64_t Label, std::vector<unsigned> &Children) {
+        std::sort(Children.begin(), Children.end());
+        Children.erase(std::unique(Children.begin(), Children.end()), Children.end());
+
+        auto &Bucket = Buckets[hash(Label, Children)];
+        for (auto ID: Bucket) {
+            auto &E = Entries[ID];
+            if (E.Label == Label && E.Children == Children)
+                return {ID, false};
+        }
+        unsigned ID = Entries.size();
+        Entries.push_back({Label, Children});
+        Bucket.push_back(ID);
+        return {ID, true};
+    }
+
+    size_t size() const { return Entries.size(); }
+
+    void clear() {
+        Entries.clear();
+        Buckets.clear();
+    }
+
+private:
+    static uint64_t mix(uint64_t X) {
+        X = (X ^ (X >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        X = (X ^ (X >> 27)) * 0x94d049bb133111ebULL;
+        return X ^ (X >> 31);
+    }
+
+    static uint64_t hash(uint64_t Label, const std::vector<unsigned> &Children) {
+        uint64_t H = mix(Label);
+        for (auto Ch: Children) H = mix(H ^ (Ch + 0x9e3779b97f4a7c15ULL + (H << 6) + (H >> 2)));
+        return H;
+    }
+};
+
+#endif //SUPPORT_HASHCONS_H
@@ -0,0 +1,97 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUPPORT_LRUCACHE_H
+#define SUPPORT_LRUCACHE_H
+
+#include <cassert>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+/// a bounded map evicting the least recently used entry when it is full
+template<typename K, typename V>
+class LRUCache {
+private:
+    typedef std::list<std::pair<K, V>> EntryList;
+
+    size_t Capacity;
+    EntryList Entries; // the most recently used entry is at the front
+    std::unordered_map<K, typename EntryList::iterator> EntryMap;
+
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Evictions = 0;
+
+public:
+    explicit LRUCache(size_t Capacity) : Capacity(Capacity) {}
+
+    /// return nullptr if the key is not cached
+    const V *get(const K &Key) {
+        auto It = EntryMap.find(Key);
+        if (It == EntryMap.end()) {
+            Misses++;
+            return nullptr;
+        }
+        Hits++;
+        Entries.splice(Entries.begin(), Entries, It->second);
+        return &It->second->second;
+    }
+
+    void put(const K &Key, const V &Val) {
+        if (Capacity == 0) return;
+        auto It = EntryMap.find(Key);
+        if (It != EntryMap.end()) {
+            It->second->second = Val;
+            Entries.splice(Entries.begin(), Entries, It->second);
+            return;
+        }
+        if (Entries.size() >= Capacity) {
+            EntryMap.erase(Entries.back().first);
+            Entries.pop_back();
+            Evictions++;
+        }
+        Entries.emplace_front(Key, Val);
+        EntryMap[Key] = Entries.begin();
+    }
+
+    void clear() {
+        Entries.clear();
+        EntryMap.clear();
+    }
+
+    void resize(size_t NewCapacity) {
+        Capacity = NewCapacity;
+        while (Entries.size() > Capacity) {
+            EntryMap.erase(Entries.back().first);
+            Entries.pop_back();
+            Evictions++;
+        }
+    }
+
+    size_t size() const { return Entries.size(); }
+
+    uint64_t hits() const { return Hits; }
+
+    uint64_t misses() const { return Misses; }
+
+    uint64_t evictions() const { return Evictions; }
+};
+
+#endif //SUPPORT_LRUCACHE_H
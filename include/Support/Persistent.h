@@ -0,0 +1,341 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUPPORT_PERSISTENT_H
+#define SUPPORT_PERSISTENT_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/// a vector whose copies share their common prefix, i.e., a persistent list linked from the last element
+/// copying, push_back, and pop_back cost O(1), indexing costs O(log n) by jump pointers, and iterating costs O(n)
+template<typename T>
+class PersistentVector {
+private:
+    struct Node {
+        T Val;
+        std::shared_ptr<const Node> Prev;
+        const Node *Jump; // an ancestor kept alive by Prev, which skips over ancestors in a skew-binary way
+        size_t Size; // the number of elements ending at this node
+    };
+
+    std::shared_ptr<const Node> Last;
+
+    const Node *node(size_t I) const {
+        assert(I < size());
+        auto *N = Last.get();
+        while (N->Size != I + 1) N = N->Jump->Size >= I + 1 ? N->Jump : N->Prev.get();
+        return N;
+    }
+
+public:
+    class const_iterator {
+    private:
+        std::shared_ptr<std::vector<const Node *>> Nodes; // from the first to the last, null for end()
+        size_t I;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T *pointer;
+        typedef const T &reference;
+
+        const_iterator(std::shared_ptr<std::vector<const Node *>> Nodes, size_t I) : Nodes(std::move(Nodes)), I(I) {}
+
+        const T &operator*() const { return (*Nodes)[I]->Val; }
+
+        const T *operator->() const { return &(*Nodes)[I]->Val; }
+
+        const_iterator &operator++() {
+            ++I;
+            return *this;
+        }
+
+        bool operator==(const const_iterator &It) const { return I == It.I; }
+
+        bool operator!=(const const_iterator &It) const { return I != It.I; }
+    };
+
+    PersistentVector() = default;
+
+    PersistentVector(const PersistentVector &) = default;
+
+    PersistentVector(PersistentVector &&) noexcept = default;
+
+    PersistentVector &operator=(const PersistentVector &) = default;
+
+    PersistentVector &operator=(PersistentVector &&) noexcept = default;
+
+    ~PersistentVector() {
+        // release the nodes only owned by this vector one by one, instead of recursively
+        while (Last && Last.use_count() == 1) {
+            auto Prev = Last->Prev;
+            Last = std::move(Prev);
+        }
+    }
+
+    size_t size() const { return Last ? Last->Size : 0; }
+
+    bool empty() const { return !Last; }
+
+    /// copies have the same id, so equal ids imply equal elements
+    const void *id() const { return Last.get(); }
+
+    const T &operator[](size_t I) const { return node(I)->Val; }
+
+    const T &at(size_t I) const { return (*this)[I]; }
+
+    const T &back() const {
+        assert(Last);
+        return Last->Val;
+    }
+
+    void push_back(const T &Val) {
+        const Node *Jump = Last.get();
+        if (Jump && Jump->Jump && Jump->Jump->Jump
+            && Jump->Size - Jump->Jump->Size == Jump->Jump->Size - Jump->Jump->Jump->Size)
+            Jump = Jump->Jump->Jump;
+        Last = std::make_shared<const Node>(Node{Val, Last, Jump, size() + 1});
+    }
+
+    void pop_back() {
+        assert(Last);
+        auto Prev = Last->Prev;
+        Last = std::move(Prev);
+    }
+
+    /// the longest prefix whose nodes are shared with the vector, i.e., the elements both have before one of them is
+    /// copied from the other, it costs O(the number of the elements not shared)
+    PersistentVector sharedPrefix(const PersistentVector &V) const {
+        auto A = Last, B = V.Last;
+        while (A != B) {
+            if (A && (!B || A->Size >= B->Size)) A = A->Prev;
+            else B = B->Prev;
+        }
+        PersistentVector Ret;
+        Ret.Last = std::move(A);
+        return Ret;
+    }
+
+    const_iterator begin() const {
+        auto Nodes = std::make_shared<std::vector<const Node *>>(size());
+        for (auto *N = Last.get(); N; N = N->Prev.get()) (*Nodes)[N->Size - 1] = N;
+        return const_iterator(std::move(Nodes), 0);
+    }
+
+    const_iterator end() const { return const_iterator(nullptr, size()); }
+};
+
+/// an ordered map whose copies share the nodes, i.e., a treap with path copying
+/// copying costs O(1), and lookup, insertion, and deletion cost O(log n)
+template<typename K, typename V>
+class PersistentMap {
+private:
+    struct Node {
+        std::pair<K, V> KV;
+        uint64_t Priority;
+        std::shared_ptr<const Node> Left;
+        std::shared_ptr<const Node> Right;
+    };
+
+    typedef std::shared_ptr<const Node> NodePtr;
+
+    NodePtr Root;
+    size_t Size = 0;
+
+public:
+    /// an in-order iterator
+    class const_iterator {
+    private:
+        std::vector<const Node *> Stack;
+
+        void descend(const Node *N) {
+            while (N) {
+                Stack.push_back(N);
+                N = N->Left.get();
+            }
+        }
+
+    public:
+        const_iterator() = default;
+
+        explicit const_iterator(const Node *N) { descend(N); }
+
+        const std::pair<K, V> &operator*() const { return Stack.back()->KV; }
+
+        const std::pair<K, V> *operator->() const { return &Stack.back()->KV; }
+
+        const_iterator &operator++() {
+            auto *N = Stack.back();
+            Stack.pop_back();
+            descend(N->Right.get());
+            return *this;
+        }
+
+        bool operator==(const const_iterator &It) const {
+            return Stack.empty() ? It.Stack.empty() : !It.Stack.empty() && Stack.back() == It.Stack.back();
+        }
+
+        bool operator!=(const const_iterator &It) const { return !(*this == It); }
+    };
+
+    size_t size() const { return Size; }
+
+    bool empty() const { return !Size; }
+
+    /// return nullptr if the key does not exist
+    const V *lookup(const K &Key) const {
+        auto *N = Root.get();
+        while (N) {
+            if (Key < N->KV.first) N = N->Left.get();
+            else if (N->KV.first < Key) N = N->Right.get();
+            else return &N->KV.second;
+        }
+        return nullptr;
+    }
+
+    bool count(const K &Key) const { return lookup(Key) != nullptr; }
+
+    /// insert the key, or overwrite its value if it exists
+    void set(const K &Key, const V &Val) {
+        bool Added = false;
+        Root = insert(Root, Key, Val, priority(Key), Added);
+        if (Added) ++Size;
+    }
+
+    void erase(const K &Key) {
+        bool Removed = false;
+        Root = remove(Root, Key, Removed);
+        if (Removed) --Size;
+    }
+
+    void clear() {
+        Root.reset();
+        Size = 0;
+    }
+
+    const_iterator begin() const { return const_iterator(Root.get()); }
+
+    const_iterator end() const { return const_iterator(); }
+
+private:
+    static uint64_t priority(const K &Key) {
+        // mix the bits so that keys like aligned pointers are spread evenly
+        uint64_t X = std::hash<K>()(Key);
+        X = (X ^ (X >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        X = (X ^ (X >> 27)) * 0x94d049bb133111ebULL;
+        return X ^ (X >> 31);
+    }
+
+    static NodePtr make(const std::pair<K, V> &KV, uint64_t P, const NodePtr &L, const NodePtr &R) {
+        return std::make_shared<const Node>(Node{KV, P, L, R});
+    }
+
+    static NodePtr insert(const NodePtr &N, const K &Key, const V &Val, uint64_t P, bool &Added) {
+        if (!N) {
+            Added = true;
+            return make({Key, Val}, P, nullptr, nullptr);
+        }
+        if (Key < N->KV.first) {
+            auto L = insert(N->Left, Key, Val, P, Added);
+            if (L->Priority > N->Priority)
+                return make(L->KV, L->Priority, L->Left, make(N->KV, N->Priority, L->Right, N->Right));
+            return make(N->KV, N->Priority, L, N->Right);
+        } else if (N->KV.first < Key) {
+            auto R = insert(N->Right, Key, Val, P, Added);
+            if (R->Priority > N->Priority)
+                return make(R->KV, R->Priority, make(N->KV, N->Priority, N->Left, R->Left), R->Right);
+            return make(N->KV, N->Priority, N->Left, R);
+        }
+        return make({Key, Val}, N->Priority, N->Left, N->Right);
+    }
+
+    static NodePtr remove(const NodePtr &N, const K &Key, bool &Removed) {
+        if (!N)
+            return N;
+        if (Key < N->KV.first) {
+            auto L = remove(N->Left, Key, Removed);
+            return Removed ? make(N->KV, N->Priority, L, N->Right) : N;
+        } else if (N->KV.first < Key) {
+            auto R = remove(N->Right, Key, Removed);
+            return Removed ? make(N->KV, N->Priority, N->Left, R) : N;
+        }
+        Removed = true;
+        return join(N->Left, N->Right);
+    }
+
+    static NodePtr join(const NodePtr &L, const NodePtr &R) {
+        if (!L) return R;
+        if (!R) return L;
+        if (L->Priority > R->Priority)
+            return make(L->KV, L->Priority, L->Left, join(L->Right, R));
+        return make(R->KV, R->Priority, join(L, R->Left), R->Right);
+    }
+};
+
+/// an ordered set whose copies share the nodes, see PersistentMap
+template<typename K>
+class PersistentSet {
+private:
+    PersistentMap<K, bool> Map;
+
+public:
+    class const_iterator {
+    private:
+        typename PersistentMap<K, bool>::const_iterator It;
+
+    public:
+        explicit const_iterator(typename PersistentMap<K, bool>::const_iterator It) : It(It) {}
+
+        const K &operator*() const { return It->first; }
+
+        const_iterator &operator++() {
+            ++It;
+            return *this;
+        }
+
+        bool operator==(const const_iterator &Other) const { return It == Other.It; }
+
+        bool operator!=(const const_iterator &Other) const { return It != Other.It; }
+    };
+
+    size_t size() const { return Map.size(); }
+
+    bool empty() const { return Map.empty(); }
+
+    bool count(const K &Key) const { return Map.count(Key); }
+
+    void insert(const K &Key) {
+        if (!Map.count(Key)) Map.set(Key, true);
+    }
+
+    void erase(const K &Key) { Map.erase(Key); }
+
+    const_iterator begin() const { return const_iterator(Map.begin()); }
+
+    const_iterator end() const { return const_iterator(Map.end()); }
+};
+
+#endif //SUPPORT_PERSISTENT_H
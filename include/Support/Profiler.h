@@ -0,0 +1,71 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUPPORT_PROFILER_H
+#define SUPPORT_PROFILER_H
+
+#include <cstdint>
+#include <llvm/ADT/StringRef.h>
+
+/// A hierarchical profiler enabled by -popeye-profile=file. Scopes nest per thread, and each of them records the
+/// wall time, the cpu time of the thread, the growth of the peak rss, and the growth of the memory used by z3.
+/// The file is in the chrome trace_event format, and additionally carries the scopes aggregated as a tree, the
+/// named counters, and the peak rss of the process.
+class Profiler {
+private:
+    static bool Enabled;
+
+public:
+    /// read the command line options, call it before any scope is opened
+    static void initialize();
+
+    /// write the profile to the file
+    static void finalize();
+
+    static bool enabled() { return Enabled; }
+
+    /// open a scope in the current thread, which must be closed by end() in the same thread
+    static void begin(const char *Category, llvm::StringRef Name);
+
+    static void end();
+
+    /// set a named counter, e.g., the size of a slice, to the value, the last value of a counter is kept
+    static void counter(llvm::StringRef Name, int64_t Value);
+};
+
+/// a scope that lasts as long as the object
+class ProfileScope {
+private:
+    bool Active;
+
+public:
+    ProfileScope(const char *Category, llvm::StringRef Name) : Active(Profiler::enabled()) {
+        if (Active) Profiler::begin(Category, Name);
+    }
+
+    ~ProfileScope() {
+        // the profiler may have been finalized when the scope is still open
+        if (Active && Profiler::enabled()) Profiler::end();
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+
+    ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+#endif //SUPPORT_PROFILER_H
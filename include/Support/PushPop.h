@@ -22,6 +22,7 @@
 #include <cassert>
 #include <ctype.h>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 template<typename T>
@@ -162,4 +163,55 @@ public:
     }
 };
 
+/// a map whose entries added after a push are dropped at the corresponding pop,
+/// useful as a memo table whose entries are only valid in the current scope
+template<typename K, typename V>
+class PushPopMap {
+private:
+    std::vector<size_t> SizeStack;
+    std::vector<K> KeyVector;
+    std::unordered_map<K, V> ElementMap;
+
+public:
+    ~PushPopMap() = default;
+
+    typename std::unordered_map<K, V>::const_iterator find(const K &Key) const {
+        return ElementMap.find(Key);
+    }
+
+    typename std::unordered_map<K, V>::const_iterator end() const {
+        return ElementMap.end();
+    }
+
+    void add(const K &Key, const V &Val) {
+        if (ElementMap.insert({Key, Val}).second) {
+            KeyVector.push_back(Key);
+        }
+    }
+
+    void push() {
+        SizeStack.push_back(size());
+    }
+
+    void pop() {
+        assert(!SizeStack.empty());
+        size_t P = SizeStack.back();
+        SizeStack.pop_back();
+        while (size() > P) {
+            ElementMap.erase(KeyVector.back());
+            KeyVector.pop_back();
+        }
+    }
+
+    void reset() {
+        std::vector<size_t>().swap(SizeStack);
+        std::vector<K>().swap(KeyVector);
+        std::unordered_map<K, V>().swap(ElementMap);
+    }
+
+    size_t size() const {
+        return KeyVector.size();
+    }
+};
+
 #endif //SUPPORT_PUSHPOP_H
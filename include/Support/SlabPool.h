@@ -0,0 +1,72 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUPPORT_SLABPOOL_H
+#define SUPPORT_SLABPOOL_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+/// Objects of the same size class are carved out of aligned slabs, so that millions of small abstract values and
+/// memory blocks neither pay the header of malloc nor scatter over the heap. A freed object goes back to the free
+/// list of its slab, and slabs becoming empty are returned to the system in bulk by release(), which is called
+/// when the analysis finishes a function or a loop. Not thread safe, objects are only created by the executor.
+class SlabPool {
+public:
+    static void *allocate(size_t Size);
+
+    static void deallocate(void *Ptr, size_t Size);
+
+    /// return the empty slabs to the system if they are a considerable part of the pool
+    static void release();
+};
+
+/// an allocator of std containers and std::allocate_shared drawing a single object from the slab pool
+template<typename T>
+struct SlabAllocator {
+    typedef T value_type;
+
+    SlabAllocator() = default;
+
+    template<typename U>
+    SlabAllocator(const SlabAllocator<U> &) {}
+
+    T *allocate(size_t N) {
+        if (N == 1) return (T *) SlabPool::allocate(sizeof(T));
+        return (T *) ::operator new(N * sizeof(T));
+    }
+
+    void deallocate(T *Ptr, size_t N) {
+        if (N == 1) SlabPool::deallocate(Ptr, sizeof(T));
+        else ::operator delete(Ptr);
+    }
+
+    template<typename U>
+    bool operator==(const SlabAllocator<U> &) const { return true; }
+
+    template<typename U>
+    bool operator!=(const SlabAllocator<U> &) const { return false; }
+};
+
+/// class-level operators routing the objects of a class hierarchy with a virtual destructor to the slab pool
+#define SLAB_ALLOCATED                                                                                \
+    static void *operator new(size_t Size) { return SlabPool::allocate(Size); }                       \
+    static void operator delete(void *Ptr, size_t Size) { SlabPool::deallocate(Ptr, Size); }
+
+#endif //SUPPORT_SLABPOOL_H
@@ -22,15 +22,18 @@
 #include <chrono>
 
 #include "Support/Debug.h"
+#include "Support/Profiler.h"
 
 class TimeRecorder {
 private:
     std::chrono::steady_clock::time_point Begin;
     std::string Prefix;
+    ProfileScope Scope;
 
 public:
     /// the prefix should be in a style of "Doing sth"
-    explicit TimeRecorder(const char *Prefix) : Begin(std::chrono::steady_clock::now()), Prefix(Prefix) {
+    explicit TimeRecorder(const char *Prefix)
+            : Begin(std::chrono::steady_clock::now()), Prefix(Prefix), Scope("step", Prefix) {
         POPEYE_INFO(this->Prefix + "...");
     }
 
@@ -0,0 +1,94 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUPPORT_WORKSTEALINGPOOL_H
+#define SUPPORT_WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed number of threads, each of which owns a deque of tasks. A task submitted by a worker goes to the back of
+/// its own deque, and a worker runs its own tasks in the LIFO order and steals from the front of others when idle.
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+private:
+    struct WorkQueue {
+        std::mutex Lock;
+        std::deque<Task> Tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> Queues;
+    std::vector<std::thread> Threads;
+
+    /// protects the sleeping and the waiting of threads
+    std::mutex Lock;
+    std::condition_variable WorkCond;
+    std::condition_variable DoneCond;
+
+    /// the number of tasks in the queues
+    std::atomic<unsigned> NumQueued{0};
+    /// the number of tasks that are either queued or running
+    std::atomic<unsigned> NumPending{0};
+    /// the number of workers waiting for tasks
+    std::atomic<unsigned> NumIdle{0};
+    std::atomic<unsigned> NextQueue{0};
+    bool Stopped = false;
+
+    /// the first exception thrown by a task, re-thrown in wait()
+    std::exception_ptr Error;
+
+public:
+    explicit WorkStealingPool(unsigned NumThreads);
+
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    void submit(Task T);
+
+    /// block until all tasks, including those submitted by tasks, are finished
+    void wait();
+
+    /// some worker is waiting and no task is queued, i.e., it is worth splitting the current task
+    bool hungry() const { return NumIdle.load() > 0 && NumQueued.load() == 0; }
+
+    unsigned size() const { return Threads.size(); }
+
+    /// the index of the worker running the current thread, or -1 if the thread is not a worker of any pool
+    static int currentWorker();
+
+private:
+    void work(unsigned ID);
+
+    bool tryRun(unsigned ID);
+
+    bool pop(unsigned ID, Task &T);
+};
+
+#endif //SUPPORT_WORKSTEALINGPOOL_H
@@ -45,6 +45,31 @@ public:
     /// call only at finalization
     static void finalize();
 
+    /// print the statistics of the caches in the z3 facade
+    static void statistics();
+
+    /// each thread works in its own z3 context, these move exprs created by another thread to the current thread,
+    /// together with the kinds of their symbols and the conditions of their phis. the thread owning the source
+    /// context must not use it during the translation
+    /// @{
+    static z3::expr translate(const z3::expr &);
+
+    static z3::expr_vector translate(const z3::expr_vector &);
+
+    /// no expr is translated while a lock is alive, so the current thread can use its context while other threads
+    /// may translate exprs from it
+    class TranslationLock {
+    public:
+        TranslationLock();
+
+        ~TranslationLock();
+
+        TranslationLock(const TranslationLock &) = delete;
+
+        TranslationLock &operator=(const TranslationLock &) = delete;
+    };
+    /// @}
+
     /// create new single values or consts
     /// @{
     static z3::expr bv_val(unsigned, unsigned);
@@ -121,8 +146,12 @@ public:
 
     static bool is_byte_array_range(const z3::expr &);
 
+    /// throw std::runtime_error if the two indices are not comparable
     static bool byte_array_element_index_less_than(const z3::expr &, const z3::expr &);
 
+    /// return 1 if less than, 0 if not less than, and -1 if the two indices are not comparable
+    static int byte_array_element_index_try_less_than(const z3::expr &, const z3::expr &);
+
     /// return the length + 1 (null terminator) of a string, which starts from the byte specified by the 1st parameter
     /// that is why it is called strlem instead of strlen ...
     static z3::expr strlem(const z3::expr &, int);
@@ -304,8 +333,19 @@ public:
 
     /// simplify the second expr according to the first and return a simplified second expr
     static z3::expr simplify(const z3::expr &, const z3::expr &);
+
+    /// collect the ids of the atoms an expr references, two exprs without a common atom never simplify each other
+    static void atoms(const z3::expr &, std::vector<unsigned> &);
     /// @}
 
+private:
+    /// the uncached kernel of simplify(E1, E2)
+    static z3::expr simplify_pair(const z3::expr &, const z3::expr &);
+
+    static void simplify_statistics();
+
+public:
+
     static z3::expr substitute(const z3::expr &, const z3::expr &, const z3::expr &);
 
     /// some checking operations
@@ -325,6 +365,21 @@ public:
 
     static void clearAssumptions();
 
+    /// incremental mode: assertions added in a scope live until the scope is popped,
+    /// and check() decides the conjunction of all live assertions without re-encoding them.
+    /// the one-shot checks below are answered by a separate solver, thus they decide their own query only.
+    /// @{
+    static void push();
+
+    static void pop(unsigned N = 1);
+
+    static void add(const z3::expr &);
+
+    static bool check();
+
+    static unsigned scopes();
+    /// @}
+
     static bool check(const z3::expr &, std::vector<uint8_t> &);
 
     static bool check(const z3::expr &);
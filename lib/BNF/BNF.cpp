@@ -23,6 +23,7 @@
 #include "BNF/BNF.h"
 #include "Support/ADT.h"
 #include "Support/Debug.h"
+#include "Support/Profiler.h"
 #include "Support/VSpell.h"
 
 #define DEBUG_TYPE "BNF"
@@ -95,12 +96,7 @@ Production::Production(const z3::expr &Expr, BNF *NF) : RHSItem(RK_Production),
                 auto &PrevVec = Indices[PrevIndicesIt];
                 if (!ADT::exists(CurrVec->MinVec, PrevVec->MaxVec,
                                  [](const BoundRef &A, const BoundRef B) {
-                                     try {
-                                         (void) (A < B); // check if comparable
-                                         return true;
-                                     } catch (const std::runtime_error &Err) {
-                                         return false;
-                                     }
+                                     return compare(A, B) != BO_Incomparable;
                                  })) {
                     IndicesIt++;
                     continue;
@@ -115,11 +111,8 @@ Production::Production(const z3::expr &Expr, BNF *NF) : RHSItem(RK_Production),
                 auto *NextVec = &Indices[IndicesIt];
                 while (ADT::exists((*NextVec)->MinVec, CurrVec->MaxVec,
                                    [](const BoundRef &A, const BoundRef B) {
-                                       try {
-                                           return A <= B;
-                                       } catch (const std::runtime_error &Err) {
-                                           return false;
-                                       }
+                                       auto Order = compare(A, B);
+                                       return Order == BO_Less || Order == BO_Equal;
                                    })) {
                     CurrVec->merge(*NextVec);
                     IndicesIt++;
@@ -162,16 +155,32 @@ Production::Production(const z3::expr &Expr, BNF *NF) : RHSItem(RK_Production),
 }
 
 BNF::BNF(const z3::expr &Expr) {
-    if (Expr.is_false() || Expr.is_true() || Z3::is_free(Expr))
-        return;
+    if (!Expr.is_false() && !Expr.is_true() && !Z3::is_free(Expr)) {
+        add(new Production(Expr, this));
+        pad();
 
-    add(new Production(Expr, this));
-    pad();
+        for (auto *P: this->Productions)
+            if (P->RHS.empty()) P->setEpsilon();
 
-    for (auto *P: this->Productions)
-        if (P->RHS.empty()) P->setEpsilon();
+        simplify();
+    }
+
+    unsigned NumProductions, NumAssertions;
+    count(NumProductions, NumAssertions);
+    Profiler::counter("bnf.productions", NumProductions);
+    Profiler::counter("bnf.assertions", NumAssertions);
+}
 
-    simplify();
+void BNF::count(unsigned &NumProductions, unsigned &NumAssertions) const {
+    NumProductions = 0;
+    NumAssertions = 0;
+    for (auto *P: Productions) {
+        if (P->nonTerminalDisjunction()) continue;
+        NumAssertions += P->getNumAssertions();
+        NumProductions += 1;
+    }
+    if (!NumProductions) NumProductions++;
+    if (VSpell::enabled()) NumProductions++;
 }
 
 BNF::~BNF() {
@@ -289,8 +298,6 @@ bool Production::containsNonTerminal() const {
 raw_ostream &operator<<(llvm::raw_ostream &O, const BNF &B) {
     O << "\n<BNF>\n";
     bool First = true;
-    unsigned NumAssertions = 0;
-    unsigned NumProductions = 0;
     for (auto *P: B.Productions) {
         if (P->nonTerminalDisjunction()) continue;
 
@@ -300,12 +307,9 @@ raw_ostream &operator<<(llvm::raw_ostream &O, const BNF &B) {
         } else {
             O << "\n    " << *P << "\n";
         }
-        NumAssertions += P->getNumAssertions();
-        NumProductions += 1;
     }
-    if (!NumProductions) {
+    if (First) {
         O << "    " << "S := epsilon;\n";
-        NumProductions++;
     }
     if (VSpell::enabled()) {
         O << "\n    ";
@@ -314,9 +318,11 @@ raw_ostream &operator<<(llvm::raw_ostream &O, const BNF &B) {
           << "C[S] "
           << "C[" << VSpell::file() << ":" << VSpell::endLine() + 1 << ":eof]";
         O << "\n";
-        NumProductions++;
     }
     O << "</BNF>\n";
+
+    unsigned NumProductions, NumAssertions;
+    B.count(NumProductions, NumAssertions);
     O << "\n# Productions: " << NumProductions << ".";
     O << "\n# Assertions: " << NumAssertions << ".";
     O << "\nAssertions/Production: " << NumAssertions / NumProductions << ".\n";
@@ -18,10 +18,12 @@
 
 #include "BNF/BNF.h"
 #include "Support/Debug.h"
+#include "Support/Profiler.h"
 
 #define DEBUG_TYPE "BNFSimplify"
 
 void BNF::simplify() {
+    ProfileScope Scope("bnf", "simplify");
     // simplify productions
     simplifyByCheckingConflict(); // remove false productions
     simplifyByMergingProductions(); // merge some productions
@@ -193,6 +195,7 @@ int BNF::getEndianness(Production *P) {
 }
 
 void BNF::simplifyByMergingFieldConstraint() {
+    ProfileScope Scope("bnf", "simplifyByMergingFieldConstraint");
     bool BigEndian = true;
     for (auto *P: Productions) {
         int Ret = getEndianness(P);
@@ -275,6 +278,7 @@ static void buildNewFields(BoundRef F, BoundRef T, std::list<Interval *> &Fields
 }
 
 void BNF::simplifyByMergingField() {
+    ProfileScope Scope("bnf", "simplifyByMergingField");
     POPEYE_DEBUG(dbgs() << "--------------------------------\n");
     POPEYE_DEBUG(dbgs() << "debugging simplifyByMergingField\n");
     POPEYE_DEBUG(dbgs() << "--------------------------------\n");
@@ -424,6 +428,7 @@ void BNF::simplifyByMergingField() {
 }
 
 void BNF::simplifyByMappingProductionNames() {
+    ProfileScope Scope("bnf", "simplifyByMappingProductionNames");
     for (auto *P: Productions) {
         if (P->nonTerminalDisjunction()) {
             for (auto &OneRHS: P->RHS) {
@@ -437,6 +442,7 @@ void BNF::simplifyByMappingProductionNames() {
 }
 
 void BNF::simplifyByMergingFieldName() {
+    ProfileScope Scope("bnf", "simplifyByMergingFieldName");
     for (auto *P: Productions) {
         std::map<std::string, std::vector<z3::expr>> NameByteMap;
         for (auto E: P->Assertions) {
@@ -489,6 +495,7 @@ void BNF::simplifyByMergingFieldName() {
 }
 
 void BNF::simplifyByMergingProductions() {
+    ProfileScope Scope("bnf", "simplifyByMergingProductions");
     // L1 := L2 | L3;
     // L2 := L4 | L5
     // =>
@@ -529,6 +536,7 @@ void BNF::simplifyByMergingProductions() {
 }
 
 void BNF::simplifyByCheckingConflict() {
+    ProfileScope Scope("bnf", "simplifyByCheckingConflict");
     for (auto It = Productions.begin(); It != Productions.end();) {
         auto *P = *It;
         if (P->Assertions.empty()) {
@@ -638,6 +646,7 @@ void BNF::simplifyByCheckingConflict() {
 }
 
 void BNF::simplifyByRemovingUnusedProductions() {
+    ProfileScope Scope("bnf", "simplifyByRemovingUnusedProductions");
     // find unused product and remove
     std::map<Production *, unsigned> RefCountMap;
     for (auto *P: Productions) {
@@ -19,12 +19,60 @@
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Debug.h>
 #include "BNF/Bound.h"
+#include "Support/LRUCache.h"
 #include "Support/Z3.h"
 
 #define DEBUG_TYPE "Bound"
 
-static bool lessThan(const z3::expr &A, const z3::expr &B) {
-    return Z3::byte_array_element_index_less_than(A, B);
+namespace {
+struct LessThanEntry {
+    z3::expr A; // keep the expressions alive so that their ids are not reused
+    z3::expr B;
+    int Result;
+};
+} // namespace
+
+static LRUCache<uint64_t, LessThanEntry> LessThanCache(1u << 14);
+
+static int lessThan(const z3::expr &A, const z3::expr &B) {
+    // 1 - true
+    // 0 - false
+    // -1 - not comparable
+    uint64_t Key = ((uint64_t) Z3::id(A) << 32) | Z3::id(B);
+    if (auto *Entry = LessThanCache.get(Key))
+        return Entry->Result;
+    auto Result = Z3::byte_array_element_index_try_less_than(A, B);
+    LessThanCache.put(Key, {A, B, Result});
+    return Result;
+}
+
+static int lessThan(const Bound &B1, const Bound &B2) {
+    if (isa<UpperBound>(&B1)) return 0;
+    if (isa<UpperBound>(&B2)) return 1;
+
+    if (isa<ConstantBound>(&B1) && isa<ConstantBound>(&B2)) {
+        return B1.constant() < B2.constant();
+    } else if (isa<ConstantBound>(&B1) && isa<SymbolicBound>(&B2)) {
+        return lessThan(Z3::bv_val(B1.constant(), 64), B2.expr());
+    } else if (isa<SymbolicBound>(&B1) && isa<ConstantBound>(&B2)) {
+        return lessThan(B1.expr(), Z3::bv_val(B2.constant(), 64));
+    } else {
+        return lessThan(B1.expr(), B2.expr());
+    }
+}
+
+BoundOrder compare(const Bound &B1, const Bound &B2) {
+    auto Less = lessThan(B1, B2);
+    if (Less == -1) return BO_Incomparable;
+    if (Less == 1) return BO_Less;
+    auto Greater = lessThan(B2, B1);
+    if (Greater == -1) return BO_Incomparable;
+    if (Greater == 1) return BO_Greater;
+    return BO_Equal;
+}
+
+BoundOrder compare(const BoundRef &B1, const BoundRef &B2) {
+    return compare(*B1, *B2);
 }
 
 raw_ostream &operator<<(llvm::raw_ostream &O, const Bound &B) {
@@ -39,18 +87,15 @@ raw_ostream &operator<<(llvm::raw_ostream &O, const Bound &B) {
 }
 
 bool operator<(const Bound &B1, const Bound &B2) {
-    if (isa<UpperBound>(&B1)) return false;
-    if (isa<UpperBound>(&B2)) return true;
-
-    if (isa<ConstantBound>(&B1) && isa<ConstantBound>(&B2)) {
-        return B1.constant() < B2.constant();
-    } else if (isa<ConstantBound>(&B1) && isa<SymbolicBound>(&B2)) {
-        return lessThan(Z3::bv_val(B1.constant(), 64), B2.expr());
-    } else if (isa<SymbolicBound>(&B1) && isa<ConstantBound>(&B2)) {
-        return lessThan(B1.expr(), Z3::bv_val(B2.constant(), 64));
-    } else {
-        return lessThan(B1.expr(), B2.expr());
+    auto Less = lessThan(B1, B2);
+    if (Less == -1) {
+        std::string ErrMsg;
+        raw_string_ostream Str(ErrMsg);
+        Str << "Error: not comparable...\n\n" << B1 << " < " << B2 << "\n";
+        Str.flush();
+        throw std::runtime_error(ErrMsg);
     }
+    return Less;
 }
 
 bool operator==(const Bound &B1, const Bound &B2) {
@@ -152,14 +197,11 @@ void BoundVec::push_back(const BoundRef &BR) {
         bool NeedAdd = false;
         for (unsigned I = 0; I < MinVec.size(); ++I) {
             auto PossibleMin = MinVec[I];
-            bool LessThan = false;
-            try {
-                LessThan = BR < PossibleMin;
-            } catch (const std::runtime_error &) {
+            auto LessThan = lessThan(*BR, *PossibleMin);
+            if (LessThan == -1) {
                 // not comparable, we need regard it as a min
                 NeedAdd = true;
-            }
-            if (LessThan) {
+            } else if (LessThan) {
                 NeedAdd = true;
                 MinVec[I] = MinVec.back();
                 MinVec.pop_back();
@@ -174,14 +216,11 @@ void BoundVec::push_back(const BoundRef &BR) {
         bool NeedAdd = false;
         for (unsigned I = 0; I < MaxVec.size(); ++I) {
             auto PossibleMax = MaxVec[I];
-            bool GreaterThan = false;
-            try {
-                GreaterThan = BR > PossibleMax;
-            } catch (const std::runtime_error &) {
-                // not comparable, we need regard it as a min
+            auto GreaterThan = lessThan(*PossibleMax, *BR);
+            if (GreaterThan == -1) {
+                // not comparable, we need regard it as a max
                 NeedAdd = true;
-            }
-            if (GreaterThan) {
+            } else if (GreaterThan) {
                 NeedAdd = true;
                 MaxVec[I] = MaxVec.back();
                 MaxVec.pop_back();
@@ -25,6 +25,7 @@
 
 #include "Core/ExecutionState.h"
 #include "Core/FunctionMap.h"
+#include "Core/FunctionSummary.h"
 #include "Support/PushPop.h"
 
 using namespace llvm;
@@ -37,6 +38,9 @@ static std::vector<GlobalMemoryBlock *> GlobalMem; // constant memory space, we
 static std::vector<HeapMemoryBlock *> HeapMem; // variable memory space
 static PushPopVector<StackMemoryBlock *> StackMem; // variable memory space
 
+static std::vector<FunctionSummary *> Recorders; // summaries being recorded, see FunctionSummary
+static bool Merging = false; // merging states does not change the footprint of a function
+
 ExecutionState::ExecutionState() = default;
 
 ExecutionState::~ExecutionState() = default;
@@ -152,7 +156,7 @@ void ExecutionState::merge(
     }
 }
 
-static unsigned subset(std::vector<z3::expr> &V1, std::vector<z3::expr> &V2) {
+static unsigned subset(const PersistentVector<z3::expr> &V1, const PersistentVector<z3::expr> &V2) {
     // return 1 if V1 < V2
     // return -1 if V1 > V2
     // return 0 if V1 = V2
@@ -179,6 +183,8 @@ static unsigned subset(std::vector<z3::expr> &V1, std::vector<z3::expr> &V2) {
 
 void ExecutionState::merge(BasicBlock *B, unsigned MergeID, std::vector<ExecutionState *> &ESVec,
                            std::vector<z3::expr> &MergeCond) {
+    Merging = true;
+
     // remove A if A's pc is a subsequence of the other B's pc
     auto *MergeFlagVec = new unsigned[ESVec.size()];
     for (unsigned I = 0; I < ESVec.size(); ++I) {
@@ -290,21 +296,21 @@ void ExecutionState::merge(BasicBlock *B, unsigned MergeID, std::vector<Executio
     merge(MergeID, MergeMap, MergeCond);
 
     // to merge named byte sets, just compute the set intersection
-    std::set<unsigned> IntersectionResults;
-    std::set<unsigned> *FirstSet = nullptr;
+    bool FirstSet = true;
     for (unsigned I = 0; I < ESVec.size(); ++I) {
         if (MergeCond[I].is_false()) continue;
         auto *ES = ESVec[I];
         assert(ES);
-        if (!FirstSet) {
+        if (FirstSet) {
             NamedByteSet = ES->NamedByteSet;
-            FirstSet = &NamedByteSet;
+            FirstSet = false;
         } else {
             auto &CurrSet = ES->NamedByteSet;
-            std::set_intersection(FirstSet->begin(), FirstSet->end(),
-                                  CurrSet.begin(), CurrSet.end(),
-                                  std::inserter(IntersectionResults, IntersectionResults.end()));
-            NamedByteSet = std::move(IntersectionResults);
+            std::vector<unsigned> Removed;
+            for (auto ID: NamedByteSet) {
+                if (!CurrSet.count(ID)) Removed.push_back(ID);
+            }
+            for (auto ID: Removed) NamedByteSet.erase(ID);
         }
     }
 
@@ -331,6 +337,7 @@ void ExecutionState::merge(BasicBlock *B, unsigned MergeID, std::vector<Executio
 
     // release memory
     delete[] MergeFlagVec;
+    Merging = false;
 }
 
 static raw_ostream &print(llvm::raw_ostream &Out, MemoryBlock &Mem, ExecutionState &ES) {
@@ -399,10 +406,11 @@ MemoryBlock *ExecutionState::stackAllocate(Function *F, Type *Ty, unsigned int N
     auto Offset = 0;
     while (auto *AbsVal = Mem->at(Offset)) {
         // the value is not managed by shared_ptr but class Memory, do not delete automatically
-        std::shared_ptr<AbstractValue> SharedAbsVal(AbsVal, [](AbstractValue *) {});
-        AbsValRevisionMap[AbsVal] = SharedAbsVal;
+        std::shared_ptr<AbstractValue> SharedAbsVal(AbsVal, [](AbstractValue *) {}, SlabAllocator<AbstractValue>());
+        AbsValRevisionMap.set(AbsVal, SharedAbsVal);
         Offset += AbsVal->bytewidth();
     }
+    for (auto *Summary: Recorders) Summary->recordAllocation(Mem);
     return Mem;
 }
 
@@ -412,15 +420,17 @@ MemoryBlock *ExecutionState::heapAllocate(Type *Ty, unsigned int Num) {
     auto Offset = 0;
     while (auto *AbsVal = Mem->at(Offset)) {
         // the value is not managed by shared_ptr but class Memory, do not delete automatically
-        std::shared_ptr<AbstractValue> SharedAbsVal(AbsVal, [](AbstractValue *) {});
-        AbsValRevisionMap[AbsVal] = SharedAbsVal;
+        std::shared_ptr<AbstractValue> SharedAbsVal(AbsVal, [](AbstractValue *) {}, SlabAllocator<AbstractValue>());
+        AbsValRevisionMap.set(AbsVal, SharedAbsVal);
         Offset += AbsVal->bytewidth();
     }
+    for (auto *Summary: Recorders) Summary->recordAllocation(Mem);
     return Mem;
 }
 
 MemoryBlock *ExecutionState::globalAllocate(Type *Ty, unsigned int Num) {
     GlobalMem.push_back(new GlobalMemoryBlock(Ty, Num));
+    for (auto *Summary: Recorders) Summary->recordAllocation(GlobalMem.back());
     return GlobalMem.back();
 }
 
@@ -464,7 +474,9 @@ AbstractValue *ExecutionState::createAbstractValue4Constant(Constant *V) {
         auto *AbsVal = registerAllocate(V);
         if (V->getType()->isIntegerTy(1)) {
             // we do not want i1 1 -> i8 -1, thus using zext
-            AbsVal->set(Z3::bv_val(CI->getZExtValue(), AbsVal->bytewidth() * 8));
+            AbsVal->set(CI->getZExtValue());
+        } else if (AbsVal->bytewidth() <= 8) {
+            AbsVal->set((uint64_t) CI->getSExtValue());
         } else {
             AbsVal->set(Z3::bv_val(CI->getSExtValue(), AbsVal->bytewidth() * 8));
         }
@@ -570,11 +582,11 @@ AbstractValue *ExecutionState::registerAllocate(Value *V) {
     }
 
     if (V->getType()->isPointerTy()) {
-        auto AV = std::make_shared<AddressValue>();
+        auto AV = std::allocate_shared<AddressValue>(SlabAllocator<AddressValue>());
         RegisterMem->emplace(V, AV);
         return AV.get();
     } else {
-        auto AV = std::make_shared<ScalarValue>(DL::getNumBytes(V->getType()));
+        auto AV = std::allocate_shared<ScalarValue>(SlabAllocator<ScalarValue>(), DL::getNumBytes(V->getType()));
         RegisterMem->emplace(V, AV);
         return AV.get();
     }
@@ -676,31 +688,30 @@ AbstractValue *ExecutionState::getValue(AbstractValue *Val, bool Store) {
     if (!Val) return nullptr;
 
     if (!Store) {
-        auto It = AbsValRevisionMap.find(Val);
-        if (It != AbsValRevisionMap.end()) {
-            return It->second.get();
-        }
+        auto *Revision = AbsValRevisionMap.lookup(Val);
         // the value has not been revised yet, a read only value, return it directly
-        return Val;
+        auto *Ret = Revision ? Revision->get() : Val;
+        if (!Merging) {
+            for (auto *Summary: Recorders) Summary->recordRead(Val, Ret);
+        }
+        return Ret;
     } else {
-        auto It = AbsValRevisionMap.find(Val);
-        if (It == AbsValRevisionMap.end()) {
-            // this should only happen when recovering exiting states from an initial state
-            // the initial state does not contain memory allocated in the loop
-            std::shared_ptr<AbstractValue> SharedAbsVal(Val, [](AbstractValue *) {});
-            It = AbsValRevisionMap.insert(std::begin(AbsValRevisionMap), std::make_pair(Val, SharedAbsVal));
-        }
-        assert(It != AbsValRevisionMap.end());
-        auto CurrentVal = It->second;
+        if (!Merging) {
+            for (auto *Summary: Recorders) Summary->recordWrite(Val);
+        }
+        auto *Revision = AbsValRevisionMap.lookup(Val);
+        // if the value is not found, it should only happen when recovering exiting states from an initial state
+        // the initial state does not contain memory allocated in the loop
+        auto *CurrentVal = Revision ? Revision->get() : Val;
         if (Val->getKind() == AbstractValue::AVK_Scalar) {
-            auto NewVal = std::make_shared<ScalarValue>(CurrentVal->bytewidth());
-            if (!CurrentVal->poison()) NewVal->assign(CurrentVal.get());
-            It->second = NewVal;
+            auto NewVal = std::allocate_shared<ScalarValue>(SlabAllocator<ScalarValue>(), CurrentVal->bytewidth());
+            if (!CurrentVal->poison()) NewVal->assign(CurrentVal);
+            AbsValRevisionMap.set(Val, NewVal);
             return NewVal.get();
         } else {
-            auto NewVal = std::make_shared<AddressValue>();
-            if (!CurrentVal->poison()) NewVal->assign(CurrentVal.get());
-            It->second = NewVal;
+            auto NewVal = std::allocate_shared<AddressValue>(SlabAllocator<AddressValue>());
+            if (!CurrentVal->poison()) NewVal->assign(CurrentVal);
+            AbsValRevisionMap.set(Val, NewVal);
             return NewVal.get();
         }
     }
@@ -723,12 +734,14 @@ void ExecutionState::gc(Function *F) {
     for (auto *St: GC) {
         for (auto *Val: *St) {
             if (!Val) return;
-            auto It = AbsValRevisionMap.find(Val);
-            assert(It != AbsValRevisionMap.end());
-            AbsValRevisionMap.erase(It);
+            assert(AbsValRevisionMap.count(Val));
+            AbsValRevisionMap.erase(Val);
         }
         delete St;
     }
+
+    // values and blocks of the callee are gone, and the slabs they leave empty can be returned in bulk
+    SlabPool::release();
 }
 
 void ExecutionState::markCall() {
@@ -737,7 +750,18 @@ void ExecutionState::markCall() {
 
 bool ExecutionState::conflict(const z3::expr &E) {
     if (E.is_false()) return true;
-    return std::any_of(PC.cbegin(), PC.cend(), [&E](const z3::expr &V) { return Z3::simplify(E, V).is_false(); });
+    if (Recorders.empty())
+        return std::any_of(PC.begin(), PC.end(), [&E](const z3::expr &V) { return Z3::simplify(E, V).is_false(); });
+
+    unsigned ConflictIdx = UINT_MAX;
+    for (unsigned K = 0; K < PC.size(); ++K) {
+        if (Z3::simplify(E, PC[K]).is_false()) {
+            ConflictIdx = K;
+            break;
+        }
+    }
+    for (auto *Summary: Recorders) Summary->recordConflictCheck(E, ConflictIdx);
+    return ConflictIdx != UINT_MAX;
 }
 
 void ExecutionState::addPC(const z3::expr &E) {
@@ -768,13 +792,23 @@ void ExecutionState::addPC(const z3::expr &E) {
         if (!AllNamed) this->PC.push_back(E);
     } else {
         auto Res = E;
-        for (auto OnePC: PC) {
-            Res = Z3::simplify(OnePC, Res);
+        unsigned FirstChangeIdx = UINT_MAX;
+        for (unsigned K = 0; K < PC.size(); ++K) {
+            auto Simplified = Z3::simplify(PC[K], Res);
+            if (FirstChangeIdx == UINT_MAX && !Z3::same(Simplified, Res)) FirstChangeIdx = K;
+            Res = Simplified;
         }
+        for (auto *Summary: Recorders) Summary->recordSimplification(E, FirstChangeIdx);
         if (!Res.is_true()) this->PC.push_back(Res);
     }
 }
 
+bool ExecutionState::named(unsigned ID) {
+    bool Named = NamedByteSet.count(ID);
+    for (auto *Summary: Recorders) Summary->recordNamedQuery(ID, Named);
+    return Named;
+}
+
 void ExecutionState::replacePC(unsigned From, const z3::expr &New) {
     assert(From < PC.size());
     while (PC.size() > From) {
@@ -852,7 +886,8 @@ ExecutionState::optimize2(std::vector<std::pair<AddressValue *, z3::expr>> &Vec,
         ValVec.push_back(Off);
         CondVec.push_back(Cond);
     }
-    return std::make_shared<AddressValue>(Vec[0].first->base(0), Z3::make_phi(PhiID, ValVec, CondVec));
+    return std::allocate_shared<AddressValue>(SlabAllocator<AddressValue>(), Vec[0].first->base(0),
+                                              Z3::make_phi(PhiID, ValVec, CondVec));
 }
 
 std::vector<StackMemoryBlock *>::const_iterator ExecutionState::stack_mem_begin() const {
@@ -861,4 +896,12 @@ std::vector<StackMemoryBlock *>::const_iterator ExecutionState::stack_mem_begin(
 
 std::vector<StackMemoryBlock *>::const_iterator ExecutionState::stack_mem_end() const {
     return StackMem.peak_end();
-}
\ No newline at end of file
+}
+void ExecutionState::startRecording(FunctionSummary *Summary) {
+    Recorders.push_back(Summary);
+}
+
+void ExecutionState::stopRecording(FunctionSummary *Summary) {
+    assert(!Recorders.empty() && Recorders.back() == Summary);
+    Recorders.pop_back();
+}
@@ -24,8 +24,10 @@
 #include <set>
 #include "Core/Executor.h"
 #include "Core/FunctionMap.h"
+#include "Core/FunctionSummary.h"
 #include "Support/Debug.h"
 #include "Support/DL.h"
+#include "Support/Profiler.h"
 #include "Support/TimeRecorder.h"
 
 #define DEBUG_TYPE "Executor"
@@ -69,6 +71,10 @@ static cl::opt<bool> EnableNaming(
         "popeye-enable-naming",
         cl::desc("inferring field"),
         cl::init(true));
+static cl::opt<bool> EnableFunctionSummary(
+        "popeye-enable-function-summary",
+        cl::desc("reuse the analysis of a callee if it is called with the same inputs"),
+        cl::init(false));
 static cl::opt<bool> EnableFSMInference(
         "popeye-enable-fsm",
         cl::desc("inferring fsm (experimental)"),
@@ -254,7 +260,7 @@ void Executor::visitPHI(PHINode &I) {
     z3::expr_vector CondVec = Z3::vec();
     bool AllPoison = true;
     for (unsigned K = 0; K < I.getNumIncomingValues(); ++K) {
-        auto MergeCond = MergeCondMap[I.getParent()][K];
+        auto MergeCond = MergeCondTable[ProcessingBlockPointer][K];
         if (MergeCond.is_false())
             continue;
 
@@ -269,7 +275,7 @@ void Executor::visitPHI(PHINode &I) {
         }
     }
     if (!AllPoison && !AVVec.empty()) AV->set(Z3::make_phi(MergeID, AVVec, CondVec));
-    if (!isa<PHINode>(I.getNextNode())) MergeCondMap.erase(I.getParent());
+    if (!isa<PHINode>(I.getNextNode())) MergeCondTable[ProcessingBlockPointer].clear();
 }
 
 void Executor::visitCall(CallInst &I) {
@@ -358,7 +364,7 @@ void Executor::visitCall(CallInst &I) {
             // CalleeAV->offset(0) << we use the first one when multiple options are available
             auto *Func = FunctionMap::getFunction(FuncID);
             if (Func && !Func->empty()) {
-                visitCallIPA(I, Func);
+                if (!visitCallMessageFree(I, Func)) visitCallIPA(I, Func);
             } else {
                 visitCallDefault(I);
             }
@@ -368,7 +374,7 @@ void Executor::visitCall(CallInst &I) {
     } else {
         if (isDeadFunction(Callee)) {
             visitCallDefault(I);
-        } else {
+        } else if (!visitCallMessageFree(I, Callee)) {
             assert(!Callee->empty());
             visitCallIPA(I);
         }
@@ -470,6 +476,11 @@ void Executor::visitXor(BinaryOperator &I) {
 
     if (I.getType()->isIntegerTy(1)) {
         // e.g., %lnot = xor i1 %cmp, true
+        uint64_t C1, C2;
+        if (cast<ScalarValue>(P1)->concrete(C1) && cast<ScalarValue>(P2)->concrete(C2)) {
+            Result->set((uint64_t) (C1 != C2));
+            return;
+        }
         if (P1->poison() || P2->poison()) return;
         auto E1 = P1->value();
         auto E2 = P2->value();
@@ -632,6 +643,72 @@ void Executor::visitAlloca(AllocaInst &I) {
     alloc(MemoryBlock::MK_Stack, &I, I.getAllocatedType(), Num);
 }
 
+/// the integer array a load G[i] reads with a symbolic i, where G is a constant global, otherwise nullptr
+static ConstantDataArray *getConstantTable(LoadInst &I) {
+    auto *GEP = dyn_cast<GetElementPtrInst>(I.getPointerOperand());
+    if (!GEP || GEP->getNumIndices() != 2) return nullptr;
+
+    auto *GV = dyn_cast<GlobalVariable>(GEP->getPointerOperand());
+    if (!GV || !GV->isConstant() || !GV->hasInitializer()) return nullptr;
+    auto *CDA = dyn_cast<ConstantDataArray>(GV->getInitializer());
+    if (!CDA || !CDA->getElementType()->isIntegerTy() || CDA->getElementType() != I.getType()) return nullptr;
+
+    auto *FirstIndex = dyn_cast<ConstantInt>(GEP->getOperand(1));
+    if (!FirstIndex || !FirstIndex->isZero() || isa<ConstantInt>(GEP->getOperand(2))) return nullptr;
+    return CDA;
+}
+
+/// table -> { placeholder of the index, the table as a decision tree over the placeholder },
+/// only the abstract interpretation uses it and runs on the main thread, so the exprs always live in the main
+/// context even though the symbolic execution gives each worker its own
+static std::map<ConstantDataArray *, std::pair<z3::expr, z3::expr>> ConstantTableMap;
+
+/// build the entries [From, To) of runs, i.e., { last index of the run -> value }, as a balanced tree of ite
+static z3::expr buildConstantTable(const std::vector<std::pair<uint64_t, uint64_t>> &Runs, size_t From, size_t To,
+                                   const z3::expr &Index, unsigned Bits) {
+    if (To - From == 1) return Z3::bv_val(Runs[From].second, Bits);
+    auto Mid = From + (To - From) / 2;
+    return Z3::ite(Z3::ule(Index, Z3::bv_val(Runs[Mid - 1].first, 64)),
+                   buildConstantTable(Runs, From, Mid, Index, Bits),
+                   buildConstantTable(Runs, Mid, To, Index, Bits));
+}
+
+bool Executor::visitLoadConstantTable(LoadInst &I, AbstractValue *Result) {
+    auto *CDA = getConstantTable(I);
+    if (!CDA) return false;
+
+    // a concrete index is handled as a usual load
+    auto *IndexAV = cast<ScalarValue>(ES->boundValue(cast<GetElementPtrInst>(I.getPointerOperand())->getOperand(2)));
+    uint64_t ConstIndex;
+    if (IndexAV->poison() || IndexAV->uint64(ConstIndex)) return false;
+    // the placeholder is 64-bit, wider indices are handled as a usual load
+    auto Index = IndexAV->value();
+    auto IndexBits = Index.get_sort().bv_size();
+    if (IndexBits > 64) return false;
+
+    auto It = ConstantTableMap.find(CDA);
+    if (It == ConstantTableMap.end()) {
+        // consecutive elements with the same value share a leaf, e.g., in a character-class table
+        std::vector<std::pair<uint64_t, uint64_t>> Runs;
+        for (uint64_t K = 0; K < CDA->getNumElements(); ++K) {
+            auto V = CDA->getElementAsInteger(K);
+            if (Runs.empty() || Runs.back().second != V) Runs.emplace_back(K, V);
+            else Runs.back().first = K;
+        }
+        auto Placeholder = Z3::bv_const("popeye.table.index", 64);
+        auto Table = buildConstantTable(Runs, 0, Runs.size(), Placeholder,
+                                        CDA->getElementType()->getIntegerBitWidth());
+        It = ConstantTableMap.emplace(CDA, std::make_pair(Placeholder, Table)).first;
+    }
+
+    auto From = Z3::vec();
+    auto To = Z3::vec();
+    From.push_back(It->second.first);
+    To.push_back(Z3::zext(Index, 64));
+    Result->set(It->second.second.substitute(From, To));
+    return true;
+}
+
 void Executor::visitLoad(LoadInst &I) {
     inferDITypeLoad(I);
 
@@ -640,6 +717,9 @@ void Executor::visitLoad(LoadInst &I) {
         return;
     }
 
+    // G[i] is modeled as a single term over i instead of a load from the address G + i
+    if (visitLoadConstantTable(I, ResultVal)) return;
+
     auto *AddrVal = cast<AddressValue>(ES->boundValue(I.getPointerOperand()));
     load(&I, AddrVal, ResultVal);
 }
@@ -1392,15 +1472,56 @@ void Executor::visitCallDefault(CallInst &I) {
     if (!I.getType()->isVoidTy()) ES->registerAllocate(&I);
 }
 
+/// callee -> how many calls to it are not analyzed because it never touches the message
+static std::map<Function *, unsigned> MessageFreeCallMap;
+
+bool Executor::visitCallMessageFree(CallInst &I, Function *Callee) {
+    if (!MTA->skippable(I, Callee)) return false;
+    visitCallDefault(I);
+    ++MessageFreeCallMap[Callee];
+    return true;
+}
+
 struct CallFrame {
     AbstractValue *RetValReceiver; // the receiver at the call site
     Executor *Exe; // old state pointer, should reset after returning from the callee
     CallInst *CallSite; // the call site
     unsigned PCSize; // the current length of pc at the call site
+    FunctionSummary *Summary; // the summary being recorded for the callee, may be nullptr
 };
 static std::vector<CallFrame> CallStack;
 static std::set<Function *> CalleeSet;
 
+/// summaries of each callee, and how many times we fail to record a summary for a callee
+/// @{
+static std::map<Function *, std::vector<std::unique_ptr<FunctionSummary>>> SummaryMap;
+static std::map<Function *, unsigned> UncacheableMap;
+static const unsigned MaxSummaryPerFunction = 8;
+static const unsigned MaxUncacheablePerFunction = 4;
+/// @}
+
+/// statistics of function summaries
+/// @{
+static unsigned NumCallAnalyzed = 0;
+static unsigned NumCallSummarized = 0;
+static unsigned NumSummaryRecorded = 0;
+/// @}
+
+bool Executor::visitCallSummary(CallInst &I, Function *Callee, const std::vector<AbstractValue *> &Args) {
+    auto It = SummaryMap.find(Callee);
+    if (It == SummaryMap.end())
+        return false;
+
+    for (auto &Summary: It->second) {
+        if (!Summary->match(ES, Args)) continue;
+        POPEYE_DEBUG(dbgs() << "Summary of " << Callee->getName() << " is reused\n");
+        Summary->replay(ES, I.getType()->isVoidTy() ? nullptr : ES->registerAllocate(&I), EscapedMemoryRevision);
+        ++NumCallSummarized;
+        return true;
+    }
+    return false;
+}
+
 void Executor::visitCallIPA(CallInst &I, Function *Callee) {
     POPEYE_DEBUG_WITH_TYPE("L2CAP",
                            if (DebugL2CAPChannel.getNumOccurrences() && CallStack.size() == 2) {
@@ -1461,25 +1582,62 @@ void Executor::visitCallIPA(CallInst &I, Function *Callee) {
             llvm_unreachable("TODO : function is recursively called!");
         }
     }
+
+    std::vector<AbstractValue *> ActualArgAVs;
+    for (unsigned K = 0; K < Callee->arg_size(); ++K) {
+        ActualArgAVs.push_back(ES->boundValue(I.getArgOperand(K)));
+    }
+
+    // summaries are neither used nor recorded in a loop, whose analysis needs to observe every memory access
+    bool UseSummary = EnableFunctionSummary && LoopStack.empty();
+    if (UseSummary && visitCallSummary(I, Callee, ActualArgAVs))
+        return;
+
+    FunctionSummary *Summary = nullptr;
+    if (UseSummary && UncacheableMap[Callee] < MaxUncacheablePerFunction
+        && SummaryMap[Callee].size() < MaxSummaryPerFunction) {
+        Summary = new FunctionSummary(ES, ActualArgAVs);
+    }
+    auto MergeIDBeforeCall = MergeID;
+    auto LoopAnalysisIDBeforeCall = LoopAnalysisID;
+    ++NumCallAnalyzed;
+
     CalleeSet.insert(Callee);
     if (I.getType()->isVoidTy()) {
-        CallStack.push_back({nullptr, this, &I, ES->pcLength()});
+        CallStack.push_back({nullptr, this, &I, ES->pcLength(), Summary});
     } else {
-        CallStack.push_back({ES->registerAllocate(&I), this, &I, ES->pcLength()});
+        CallStack.push_back({ES->registerAllocate(&I), this, &I, ES->pcLength(), Summary});
     }
 
     Executor CalleeExectuor(DriverPass);
-    CalleeExectuor.StateMap[&Callee->getEntryBlock()].push_back(ES);
+    CalleeExectuor.ES = ES; // the entry state of the callee
     // prepare parameters
     for (unsigned K = 0; K < Callee->arg_size(); ++K) {
         auto *FormalArg = Callee->getArg(K);
-        auto *ActualArg = I.getArgOperand(K);
         auto *FormalArgAV = ES->registerAllocate(FormalArg);
-        auto *ActualArgAV = ES->boundValue(ActualArg);
-        FormalArgAV->assign(ActualArgAV);
+        FormalArgAV->assign(ActualArgAVs[K]);
     }
     ES->markCall();
     CalleeExectuor.visit(Callee);
+
+    if (Summary) {
+        Summary->finish(ES, I.getType()->isVoidTy() ? nullptr : ES->boundValue(&I));
+        // phi values and loop summaries introduce symbols that should be unique to each call
+        if (LoopAnalysisID != LoopAnalysisIDBeforeCall || MergeID < MergeIDBeforeCall) {
+            Summary->invalidate();
+        } else {
+            for (auto ID = MergeIDBeforeCall + 1; ID <= MergeID && Summary->cacheable(); ++ID) {
+                if (Z3::has_phi(ID)) Summary->invalidate();
+            }
+        }
+        if (Summary->cacheable()) {
+            SummaryMap[Callee].emplace_back(Summary);
+            ++NumSummaryRecorded;
+        } else {
+            UncacheableMap[Callee]++;
+            delete Summary;
+        }
+    }
 }
 
 void Executor::visitRet(ReturnInst &I) {
@@ -1504,20 +1662,49 @@ void Executor::visitRet(ReturnInst &I) {
         }
 
         auto *CallerExecutor = CallStack.back().Exe;
+        auto *Summary = CallStack.back().Summary;
         CallerExecutor->ES = ES;
         for (auto *Abs: EscapedMemoryRevision) {
             if (StackMemory.count(Abs)) continue; // stack mem cannot escape
             CallerExecutor->EscapedMemoryRevision.insert(Abs);
             if (!CallerExecutor->LoopStack.empty()) CallerExecutor->LoopStack.back()->recordMemoryRevised(Abs);
+            if (Summary) Summary->recordEscape(Abs);
         }
         CallStack.pop_back();
         CalleeSet.erase(I.getParent()->getParent()); // to test recursive call
 
+        // summaries referencing the stack memory to release are useless
+        std::set<MemoryBlock *> StackBlocks(ES->stack_mem_begin(), ES->stack_mem_end());
+        for (auto &SummaryIt: SummaryMap) {
+            auto &SummaryVec = SummaryIt.second;
+            SummaryVec.erase(std::remove_if(SummaryVec.begin(), SummaryVec.end(),
+                                            [&](const std::unique_ptr<FunctionSummary> &S) {
+                                                return S->references(StackBlocks, StackMemory);
+                                            }), SummaryVec.end());
+        }
+
         // gc stack and register
         ES->gc(I.getParent()->getParent());
     } else {
+        if (EnableFunctionSummary) {
+            POPEYE_INFO("Function summary: " << NumSummaryRecorded << " recorded, "
+                                             << NumCallSummarized << " of "
+                                             << NumCallAnalyzed + NumCallSummarized << " calls summarized");
+        }
+        if (!MessageFreeCallMap.empty()) {
+            unsigned NumSkipped = 0;
+            for (auto &It: MessageFreeCallMap) NumSkipped += It.second;
+            POPEYE_INFO("Message taint: " << NumSkipped << " calls to " << MessageFreeCallMap.size()
+                                          << " message-free functions not analyzed:");
+            std::map<std::string, unsigned> SortedCallMap;
+            for (auto &It: MessageFreeCallMap) SortedCallMap[It.first->getName().str()] = It.second;
+            for (auto &It: SortedCallMap) POPEYE_INFO("    " << It.first << " x " << It.second);
+            MessageFreeCallMap.clear();
+        }
         std::vector<CallFrame>().swap(CallStack);
         std::set<Function *>().swap(CalleeSet);
+        SummaryMap.clear();
+        UncacheableMap.clear();
         ES->gc(I.getParent()->getParent());
         PC = ES->pc();
     }
@@ -1702,42 +1889,26 @@ void Executor::sortBlocks(Function &F, std::vector<BasicBlock *> &DFSOrderVec) {
     for (auto *B: OrderedList) DFSOrderVec.push_back(B);
 }
 
-void Executor::visitFunction(Function &F) {
-    DEBUG_FUNC(&F, dbgs() << "Start to analyze function " + F.getName() + "...\n");
-
-    // entry function, no call inst for the entry function, so we push the call stack here
-    if (CallStack.empty()) {
-        CallStack.push_back({nullptr, nullptr, nullptr, 0});
-        ES = new ExecutionState;
-        ES->markCall();
-
-        // set the entry state of the main function
-        auto &Entry = F.getEntryBlock();
-        auto It = StateMap.find(&Entry);
-        assert (It == StateMap.end());
-        StateMap[&Entry].push_back(ES);
-        initializeGlobals(F);
-    }
-
-    // count how many times this function is called, for debugging purposes
-    setCounter(&F);
-    POPEYE_INFO("Processing " << space(CallStack.size() - 1) << F.getName() << "@" << getCounter(&F));
+/// the block order, block indices and loop info of a function, which only depend on the cfg
+/// and thus are computed once no matter how many times the function is called
+struct BlockTable {
+    FunctionLoopInformation *FLI = nullptr;
+    std::vector<BasicBlock *> DFSOrderVec;
+    DenseMap<BasicBlock *, unsigned> BlockIdx;
+    unsigned RealBlockNum = 0;
+};
+static std::map<Function *, std::unique_ptr<BlockTable>> BlockTableMap;
 
-    // collecting the loop information
-    FLI = DriverPass->getAnalysis<LoopInformationAnalysis>().getLoopInfo(F);
-    DMA = &DriverPass->getAnalysis<DistinctMetadataAnalysis>();
+const BlockTable *Executor::getBlockTable(Function &F) {
+    auto &Table = BlockTableMap[&F];
+    if (Table) return Table.get();
 
-    // sort blocks
-    std::vector<BasicBlock *> DFSOrderVec;
+    Table.reset(new BlockTable);
+    FLI = Table->FLI = DriverPass->getAnalysis<LoopInformationAnalysis>().getLoopInfo(F);
+    auto &DFSOrderVec = Table->DFSOrderVec;
     sortBlocks(F, DFSOrderVec);
+    for (unsigned I = 0; I < DFSOrderVec.size(); ++I) Table->BlockIdx[DFSOrderVec[I]] = I;
 
-    // set loop header index
-    for (unsigned I = 0; I < DFSOrderVec.size(); ++I) {
-        auto *B = DFSOrderVec[I];
-        if (auto *LP = FLI->isLoopHeader(B)) {
-            LoopHeaderIdxMap[LP] = I;
-        }
-    }
     unsigned RealBlockNum = DFSOrderVec.size();
     while (RealBlockNum > 0) {
         auto *LastBlock = DFSOrderVec[RealBlockNum - 1];
@@ -1754,12 +1925,51 @@ void Executor::visitFunction(Function &F) {
         errs() << F.getName() << "\n";
         llvm_unreachable("Error: reach a function never returns!");
     }
+    Table->RealBlockNum = RealBlockNum;
+    return Table.get();
+}
+
+unsigned Executor::blockIndex(BasicBlock *B) const {
+    auto It = Blocks->BlockIdx.find(B);
+    assert(It != Blocks->BlockIdx.end());
+    return It->second;
+}
+
+void Executor::visitFunction(Function &F) {
+    ProfileScope Scope("function", F.getName());
+    DEBUG_FUNC(&F, dbgs() << "Start to analyze function " + F.getName() + "...\n");
+
+    // entry function, no call inst for the entry function, so we push the call stack here
+    // for a callee, ES has been set as its entry state by the caller
+    if (CallStack.empty()) {
+        CallStack.push_back({nullptr, nullptr, nullptr, 0, nullptr});
+        ES = new ExecutionState;
+        ES->markCall();
+        initializeGlobals(F);
+    }
+
+    // count how many times this function is called, for debugging purposes
+    setCounter(&F);
+    POPEYE_INFO("Processing " << space(CallStack.size() - 1) << F.getName() << "@" << getCounter(&F));
+
+    // collecting the loop information and sorting blocks
+    Blocks = getBlockTable(F);
+    FLI = Blocks->FLI;
+    DMA = &DriverPass->getAnalysis<DistinctMetadataAnalysis>();
+    MTA = &DriverPass->getAnalysis<MessageTaintAnalysis>();
+    auto &DFSOrderVec = Blocks->DFSOrderVec;
+    unsigned RealBlockNum = Blocks->RealBlockNum;
+
+    // the entry block is always the first one in the dfs order
+    assert(DFSOrderVec[0] == &F.getEntryBlock());
+    StateTable.resize(DFSOrderVec.size());
+    MergeCondTable.resize(DFSOrderVec.size());
+    StateTable[0].push_back(ES);
+    ES = nullptr;
 
     // the initial state of a function
     DEBUG_FUNC(&F, {
-        auto &Entry = F.getEntryBlock();
-        auto It = StateMap.find(&Entry);
-        auto XES = It->second[0];
+        auto XES = StateTable[0][0];
         for (unsigned I = 0; I < F.arg_size(); ++I)
             dbgs() << *F.getArg(I) << " ... " << XES->boundValue(F.getArg(I))->str() << "\n";
     });
@@ -1769,8 +1979,8 @@ void Executor::visitFunction(Function &F) {
     // start data flow analysis
     for (ProcessingBlockPointer = 0; ProcessingBlockPointer < RealBlockNum;) {
         auto *B = DFSOrderVec[ProcessingBlockPointer];
-        auto StateIt = StateMap.find(B);
-        if (StateIt == StateMap.end()) {
+        auto &StateVec = StateTable[ProcessingBlockPointer];
+        if (StateVec.empty()) {
             SkippedBlocks.push_back(B);
             if (isa<ReturnInst>(B->getTerminator())) {
                 errs() << "All blocks: \n\t";
@@ -1794,22 +2004,7 @@ void Executor::visitFunction(Function &F) {
             continue;
         }
         AnalyzedBlocks.push_back(B);
-        auto &StateVec = StateIt->second;
-        if (StateVec.empty()) {
-            errs() << "All blocks: \n\t";
-            for (auto *X: DFSOrderVec)
-                errs() << X->getName() << ", ";
-            errs() << "\n";
-            errs() << "Analyzed blocks: \n\t";
-            for (auto *X: AnalyzedBlocks)
-                errs() << X->getName() << ", ";
-            errs() << "\n";
-            errs() << "Skipped blocks: \n\t";
-            for (auto *X: SkippedBlocks)
-                errs() << X->getName() << ", ";
-            errs() << "\n";
-            llvm_unreachable(("Error: no state found for " + B->getName()).str().c_str());
-        } else if (StateVec.size() == 1) {
+        if (StateVec.size() == 1) {
             ES = StateVec[0];
         } else {
             DEBUG_FUNC(&F, {
@@ -1821,7 +2016,7 @@ void Executor::visitFunction(Function &F) {
             });
 
             ES = new ExecutionState;
-            ES->merge(B, ++MergeID, StateVec, MergeCondMap[B]);
+            ES->merge(B, ++MergeID, StateVec, MergeCondTable[ProcessingBlockPointer]);
             assert(!FLI->isLoopHeader(B));
 
             DEBUG_FUNC(&F, {
@@ -1833,8 +2028,8 @@ void Executor::visitFunction(Function &F) {
 
             for (auto *State: StateVec) delete State;
         }
-        StateMap.erase(StateIt);
-        if (B->begin()->getOpcode() != Instruction::PHI) MergeCondMap.erase(B);
+        StateVec.clear();
+        if (B->begin()->getOpcode() != Instruction::PHI) MergeCondTable[ProcessingBlockPointer].clear();
 
         beforeVisit(*B);
         visit(B);
@@ -1867,26 +2062,33 @@ void Executor::visitFunction(Function &F) {
 
     // gc states before blocks that will not be analyzed
     for (; ProcessingBlockPointer < DFSOrderVec.size(); ++ProcessingBlockPointer) {
-        auto *B = DFSOrderVec[ProcessingBlockPointer];
-        auto StateIt = StateMap.find(B);
-        if (StateIt == StateMap.end()) {
-            continue;
-        }
-        auto &StateVec = StateIt->second;
-        for (auto *State: StateVec) delete State;
+        for (auto *State: StateTable[ProcessingBlockPointer]) delete State;
+    }
+
+    // the entry function returns, drop the block tables as the loop info they refer to belongs to the driver pass
+    if (CallStack.empty()) {
+        BlockTableMap.clear();
+        Blocks = nullptr;
     }
 }
 
+/// function:line of a loop header, for profiling
+static std::string loopName(BasicBlock &Header) {
+    std::string Name = Header.getParent()->getName().str();
+    auto *Term = Header.getTerminator();
+    if (Term->hasMetadata("dbg")) Name.append(":").append(std::to_string(Term->getDebugLoc().getLine()));
+    else Name.append(":").append(Header.getName().str());
+    return Name;
+}
+
 void Executor::beforeVisit(BasicBlock &B) {
     if (auto *LP = FLI->isLoopHeader(&B)) {
         if (!LoopStack.empty() && LoopStack.back()->getLoop() == LP) {
             // an old loop, to visit the loop body again, clear the state buffer
-            for (auto *BlockInLoop: *LP) {
-                auto It = StateMap.find(BlockInLoop);
-                if (It != StateMap.end()) StateMap.erase(It);
-            }
+            for (auto *BlockInLoop: *LP) StateTable[blockIndex(BlockInLoop)].clear();
         } else {
             // a new loop
+            if (Profiler::enabled()) Profiler::begin("loop", loopName(B));
             LoopStack.push_back(new LoopSummaryAnalysis(LP, ES, MergeID, ++LoopAnalysisID));
         }
         // increase the trip count, start a new trip/iteration
@@ -1916,9 +2118,7 @@ void Executor::afterVisit(BasicBlock &B) {
         assert(TopLP->getLoop() == LP);
         if (ES && !TopLP->finish()) { // ES != NULL means we can reach this block
             // let's go back to visit the loop again
-            auto It = LoopHeaderIdxMap.find(LP);
-            assert(It != LoopHeaderIdxMap.end());
-            ProcessingBlockPointer = It->second;
+            ProcessingBlockPointer = blockIndex(LP->getHeader());
             // propagate latch to header
             auto *NextIterationInitialState = TopLP->getNextInitialState(ES);
             propagate(&B, LP->getHeader(), NextIterationInitialState);
@@ -1961,6 +2161,8 @@ void Executor::afterVisit(BasicBlock &B) {
 
             delete LoopStack.back();
             LoopStack.pop_back();
+            if (Profiler::enabled()) Profiler::end();
+            SlabPool::release(); // the states and values of the iterations are gone
             ProcessingBlockPointer++;
         }
     } else {
@@ -1973,7 +2175,7 @@ void Executor::propagate(BasicBlock *From, BasicBlock *To, ExecutionState *State
     if (!State)
         return;
 
-    std::vector<ExecutionState *> &Vec = StateMap[To];
+    std::vector<ExecutionState *> &Vec = StateTable[blockIndex(To)];
     if (auto *LP = FLI->isLoopHeader(To)) {
         // loop header always has one input state,
         // either from prehead or from latch
@@ -2098,6 +2300,10 @@ void Executor::store(StoreInst *I, AddressValue *Addr, AbstractValue *V2S) {
 void Executor::_store(StoreInst *I, AbstractValue *V2S, MemoryBlock *Base, const z3::expr &Offset, const z3::expr &Cond,
                       bool SU) {
     if (auto *MsgBuff = dyn_cast<MessageBuffer>(Base)) {
+        // overwriting the message buffer cannot be replayed by a function summary
+        for (auto &Frame: CallStack) {
+            if (Frame.Summary) Frame.Summary->invalidate();
+        }
         if (isa<ScalarValue>(V2S))
             MsgBuff->store(V2S->value(), Offset);
         POPEYE_WARN("Try to overwrite the data buffer via store!");
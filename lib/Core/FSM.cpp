@@ -47,32 +47,31 @@ FSM::FSM(const SliceGraph *G) {
     // create state transitions
     // 1. forward slicing, and collect reachable nodes and transit-to nodes
     // 2. use the forward slice to collect constraints to each transit-to node
+    // both are done for all states in a single sweep over the slice graph
+    std::vector<int64_t> SrcStateIds;
     for (auto *StateNode: StateNodes) {
         int64_t SrcStateId;
-        FSMStateRef SrcState;
         if (Z3::is_numeral_i64(StateNode->getCondition().arg(1), SrcStateId)) {
-            SrcState = this->ID2StateMap.at(SrcStateId);
+            SrcStateIds.push_back(SrcStateId);
         } else {
             llvm_unreachable("what... not possible...");
         }
+    }
 
-        std::vector<SliceGraphNode *> Targets;
-        G->dfs([&Targets, SrcStateId](SliceGraphNode *Node) {
-            auto Expr = Node->getCondition();
-            int64_t StateId;
-            if (Z3::is_transit_to(Expr) && Z3::is_numeral_i64(Expr.arg(0), StateId) && StateId != SrcStateId) {
-                // StateId != SrcStateId (all self-cycles should be implicit)
-                Targets.emplace_back(Node);
-            }
-        }, StateNode);
-
-        z3::expr_vector CondVec = G->collectConstraints(StateNode, Targets, true);
-        for (unsigned K = 0; K < Targets.size(); ++K) {
-            auto *Target = Targets[K];
+    auto IsTarget = [&SrcStateIds](unsigned S, SliceGraphNode *Node) {
+        auto Expr = Node->getCondition();
+        int64_t StateId;
+        // StateId != SrcStateId (all self-cycles should be implicit)
+        return Z3::is_transit_to(Expr) && Z3::is_numeral_i64(Expr.arg(0), StateId) && StateId != SrcStateIds[S];
+    };
+    auto TargetVecs = G->collectConstraints(StateNodes, IsTarget, true);
+    for (unsigned S = 0; S < StateNodes.size(); ++S) {
+        auto SrcState = this->ID2StateMap.at(SrcStateIds[S]);
+        for (auto &It: TargetVecs[S]) {
             int64_t TargetId;
-            auto Expr = Target->getCondition();
+            auto Expr = It.first->getCondition();
             if (Z3::is_transit_to(Expr) && Z3::is_numeral_i64(Expr.arg(0), TargetId)) {
-                SrcState->addTransition(CondVec[K], this->ID2StateMap.at(TargetId));
+                SrcState->addTransition(It.second, this->ID2StateMap.at(TargetId));
             } else {
                 llvm_unreachable("what... not possible...");
             }
@@ -0,0 +1,262 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Core/ExecutionState.h"
+#include "Core/FunctionSummary.h"
+
+FunctionSummary::FunctionSummary(ExecutionState *ES, const std::vector<AbstractValue *> &Args) {
+    for (auto *Arg: Args) {
+        if (!Arg) {
+            invalidate();
+            break;
+        }
+        ArgVec.emplace_back(Arg->clone());
+    }
+    for (auto &E: ES->PC) CallerPC.push_back(Z3::id(E));
+    CallerNamedByteSet = ES->NamedByteSet;
+    ExecutionState::startRecording(this);
+}
+
+void FunctionSummary::finish(ExecutionState *ES, AbstractValue *Ret) {
+    ExecutionState::stopRecording(this);
+
+    // the callee may only append conditions to the caller's pc
+    if (Cacheable && ES->PC.size() >= CallerPC.size()) {
+        for (unsigned K = 0; K < ES->PC.size(); ++K) {
+            if (K >= CallerPC.size()) {
+                PCVec.push_back(ES->PC[K]);
+            } else if (Z3::id(ES->PC[K]) != CallerPC[K]) {
+                invalidate();
+                break;
+            }
+        }
+    } else {
+        invalidate();
+    }
+
+    // the callee may only name more bytes
+    if (Cacheable) {
+        for (auto ID: CallerNamedByteSet) {
+            if (!ES->NamedByteSet.count(ID)) {
+                invalidate();
+                break;
+            }
+        }
+        // a byte is named after it is checked to be unnamed, thus match() checks the bytes newly named as well
+        for (auto ID: ES->NamedByteSet) {
+            if (CallerNamedByteSet.count(ID)) continue;
+            if (!UnnamedByteSet.count(ID)) invalidate();
+            NamedByteVec.push_back(ID);
+        }
+        UnnamedByteVec.assign(UnnamedByteSet.begin(), UnnamedByteSet.end());
+        CallerNamedQueryVec.assign(CallerNamedQuerySet.begin(), CallerNamedQuerySet.end());
+    }
+
+    if (Cacheable && Ret) {
+        RetVal.reset(Ret->clone());
+        if (escapes(RetVal.get())) invalidate();
+    }
+
+    for (auto It = WrittenValSet.begin(), E = WrittenValSet.end(); Cacheable && It != E; ++It) {
+        auto *Key = *It;
+        std::shared_ptr<AbstractValue> Val(ES->getValue(Key, false)->clone());
+        if (escapes(Val.get())) invalidate();
+        WriteVec.emplace_back(Key, Val);
+        CellSet.insert(Key);
+    }
+
+    for (auto *Key: EscapedSet) {
+        if (LocalValSet.count(Key)) invalidate();
+        EscapedVec.push_back(Key);
+        CellSet.insert(Key);
+    }
+
+    for (unsigned K = 0; Cacheable && K < ReadVec.size(); ++K) {
+        if (escapes(ReadVec[K].second.get())) invalidate();
+        CellSet.insert(ReadVec[K].first);
+    }
+
+    for (unsigned K = 0; Cacheable && K < ArgVec.size(); ++K) {
+        if (escapes(ArgVec[K].get())) invalidate();
+    }
+
+    // release the states only used for recording
+    std::vector<unsigned>().swap(CallerPC);
+    CallerNamedByteSet = PersistentSet<unsigned>();
+    std::set<MemoryBlock *>().swap(LocalMemSet);
+    std::set<AbstractValue *>().swap(LocalValSet);
+    std::set<AbstractValue *>().swap(AccessedValSet);
+    std::set<AbstractValue *>().swap(WrittenValSet);
+    std::set<unsigned>().swap(UnnamedByteSet);
+    std::set<unsigned>().swap(CallerNamedQuerySet);
+    std::set<AbstractValue *>().swap(EscapedSet);
+}
+
+bool FunctionSummary::match(ExecutionState *ES, const std::vector<AbstractValue *> &Args) const {
+    assert(Cacheable);
+    if (ArgVec.size() != Args.size())
+        return false;
+    for (unsigned K = 0; K < Args.size(); ++K) {
+        if (!equivalent(ArgVec[K].get(), Args[K]))
+            return false;
+    }
+    for (auto &It: ReadVec) {
+        if (!equivalent(It.second.get(), ES->getValue(It.first, false)))
+            return false;
+    }
+    for (auto ID: CallerNamedQueryVec) {
+        if (!ES->named(ID))
+            return false;
+    }
+    // the callee names the bytes it finds unnamed. if the caller has named none of them, the callee names them
+    // as recorded, and if the caller has named all of them, e.g., by an earlier call, naming them again is a no-op.
+    // otherwise, the callee would name a part of them, which cannot be replayed
+    unsigned NumNamed = 0;
+    for (auto ID: UnnamedByteVec) NumNamed += ES->named(ID);
+    if (NumNamed && NumNamed != UnnamedByteVec.size())
+        return false;
+    // the conditions the callee checks against the pc must not be affected by the caller's pc
+    for (auto &Cond: ConflictCheckVec) {
+        if (ES->conflict(Cond))
+            return false;
+    }
+    for (auto &Cond: SimplifyVec) {
+        auto Res = Cond;
+        for (auto &E: ES->PC) Res = Z3::simplify(E, Res);
+        if (!Z3::same(Res, Cond))
+            return false;
+    }
+    return true;
+}
+
+void FunctionSummary::replay(ExecutionState *ES, AbstractValue *Receiver, std::set<AbstractValue *> &Escaped) const {
+    assert(Cacheable);
+    for (auto &It: WriteVec)
+        ES->getValue(It.first, true)->assign(It.second.get());
+    Escaped.insert(EscapedVec.begin(), EscapedVec.end());
+    if (renamed(ES)) {
+        // every naming the callee does is skipped as its bytes have been named
+        for (auto &E: PCVec) {
+            if (!Z3::is_naming_eq(E)) ES->PC.push_back(E);
+        }
+    } else {
+        for (auto &E: PCVec) ES->PC.push_back(E);
+        for (auto ID: NamedByteVec) ES->NamedByteSet.insert(ID);
+    }
+    if (Receiver) {
+        assert(RetVal);
+        Receiver->assign(RetVal.get());
+    }
+}
+
+bool FunctionSummary::references(const std::set<MemoryBlock *> &Blocks, const std::set<AbstractValue *> &Cells) const {
+    for (auto *Block: BlockSet) {
+        if (Blocks.count(Block))
+            return true;
+    }
+    for (auto *Cell: CellSet) {
+        if (Cells.count(Cell))
+            return true;
+    }
+    return false;
+}
+
+void FunctionSummary::recordAllocation(MemoryBlock *Mem) {
+    LocalMemSet.insert(Mem);
+    for (auto *Val: *Mem) {
+        if (Val) LocalValSet.insert(Val);
+    }
+}
+
+void FunctionSummary::recordRead(AbstractValue *Key, AbstractValue *Val) {
+    if (!Cacheable || LocalValSet.count(Key) || !AccessedValSet.insert(Key).second)
+        return;
+    // the first access to a memory cell of the caller is a read, the value read is an input
+    ReadVec.emplace_back(Key, std::shared_ptr<AbstractValue>(Val->clone()));
+}
+
+void FunctionSummary::recordWrite(AbstractValue *Key) {
+    if (!Cacheable || LocalValSet.count(Key))
+        return;
+    AccessedValSet.insert(Key);
+    WrittenValSet.insert(Key);
+}
+
+void FunctionSummary::recordEscape(AbstractValue *Key) {
+    EscapedSet.insert(Key);
+}
+
+void FunctionSummary::recordConflictCheck(const z3::expr &Cond, unsigned ConflictIdx) {
+    if (!Cacheable)
+        return;
+    // pruning a branch due to the caller's pc makes the summary specific to the caller
+    if (ConflictIdx < CallerPC.size()) invalidate();
+    else ConflictCheckVec.push_back(Cond);
+}
+
+void FunctionSummary::recordSimplification(const z3::expr &Cond, unsigned FirstChangeIdx) {
+    if (!Cacheable)
+        return;
+    // simplifying a condition using the caller's pc makes the summary specific to the caller
+    if (FirstChangeIdx < CallerPC.size()) invalidate();
+    else SimplifyVec.push_back(Cond);
+}
+
+void FunctionSummary::recordNamedQuery(unsigned ID, bool Named) {
+    if (!Cacheable)
+        return;
+    if (!Named) UnnamedByteSet.insert(ID);
+    else if (CallerNamedByteSet.count(ID)) CallerNamedQuerySet.insert(ID);
+}
+
+bool FunctionSummary::escapes(AbstractValue *V) {
+    if (!isa<AddressValue>(V))
+        return false;
+    for (unsigned K = 0; K < V->size(); ++K) {
+        auto *Base = V->base(K);
+        if (!Base) continue;
+        // a summarized heap changes its state when being stored to, which cannot be replayed
+        if (LocalMemSet.count(Base) || Base->isSummarizedHeap())
+            return true;
+        BlockSet.insert(Base);
+    }
+    return false;
+}
+
+bool FunctionSummary::renamed(ExecutionState *ES) const {
+    // match() has checked that either all or none of the bytes are named
+    return !UnnamedByteVec.empty() && ES->NamedByteSet.count(UnnamedByteVec[0]);
+}
+
+bool FunctionSummary::equivalent(AbstractValue *V1, AbstractValue *V2) {
+    if (V1 == V2)
+        return true;
+    if (!V1 || !V2 || V1->getKind() != V2->getKind() || V1->bytewidth() != V2->bytewidth())
+        return false;
+    if (V1->poison() || V2->poison())
+        return V1->poison() && V2->poison();
+    if (isa<ScalarValue>(V1))
+        return Z3::same(V1->value(), V2->value());
+    if (V1->size() != V2->size())
+        return false;
+    for (unsigned K = 0; K < V1->size(); ++K) {
+        if (V1->base(K) != V2->base(K) || !Z3::same(V1->offset(K), V2->offset(K)))
+            return false;
+    }
+    return true;
+}
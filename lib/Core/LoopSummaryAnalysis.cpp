@@ -287,7 +287,7 @@ void LoopSummaryAnalysis::recoverExitingStates() {
     for (auto &It: State->Iterations[0]->RegisterValues) {
         auto *AbsV = It.second;
         if (isa<ScalarValue>(AbsV)) {
-            auto Val = AbsV->value().substitute(From, To);
+            auto Val = z3::expr(AbsV->value()).substitute(From, To);
             InitialState->boundValue(It.first)->set(Val);
         } else {
             auto Val = AbsV->offset(0).substitute(From, To);
@@ -305,7 +305,7 @@ void LoopSummaryAnalysis::recoverExitingStates() {
             auto *AbsV = It.second;
             if (isa<ScalarValue>(AbsV)) {
                 auto ExitingAbsV = ExitingState->getValue(It.first.second, true);
-                auto Val = AbsV->value().substitute(From, To);
+                auto Val = z3::expr(AbsV->value()).substitute(From, To);
                 ExitingAbsV->set(Val);
             } else {
                 auto ExitingAbsV = ExitingState->getValue(It.first.second, true);
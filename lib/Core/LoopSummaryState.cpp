@@ -627,7 +627,7 @@ static void summarize(AbstractValue *V1, AbstractValue *V2, AbstractValue *V3, c
 
     auto E = summarize(E1, E2, E3, SG, TC);
     if (isa<AddressValue>(V1)) V1->offset(0) = E;
-    else V1->value() = E;
+    else V1->set(E);
 }
 
 void LoopSummaryState::summarizeTrip() {
@@ -0,0 +1,314 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Support/CommandLine.h>
+#include "Core/MessageTaintAnalysis.h"
+#include "Support/Debug.h"
+
+#define DEBUG_TYPE "MessageTaintAnalysis"
+
+using namespace llvm;
+
+static cl::opt<bool> EnableMessageTaint("popeye-skip-message-free",
+                                        cl::desc("do not analyze calls to functions never touching the message"),
+                                        cl::init(true));
+
+char MessageTaintAnalysis::ID = 0;
+static RegisterPass<MessageTaintAnalysis> X(DEBUG_TYPE, "A module pass finding functions never touching the message");
+
+static bool isBuiltIn(Function *F) {
+    return F->getName().startswith("popeye_");
+}
+
+static bool isMessageSource(Function *F) {
+    return F->getName() == "popeye_make_message" || F->getName() == "popeye_make_message_length";
+}
+
+/// the functions writing memory pointed to by their first argument, which the executor models
+static bool isMemoryWriter(Function *F) {
+    switch (F->getIntrinsicID()) {
+        case Intrinsic::memcpy:
+        case Intrinsic::memcpy_element_unordered_atomic:
+        case Intrinsic::memmove:
+        case Intrinsic::memmove_element_unordered_atomic:
+        case Intrinsic::memset:
+        case Intrinsic::memset_element_unordered_atomic:
+            return true;
+        default:
+            break;
+    }
+    auto Name = F->getName();
+    return Name == "memcpy" || Name == "memmove" || Name == "memset" || Name == "strcpy" || Name == "strncpy"
+           || Name == "__memcpy_chk" || Name == "__memset_chk" || Name == "__strncpy_chk";
+}
+
+/// a base object we can name, otherwise, the pointer is loaded from memory or made from an integer
+static bool isIdentifiedObject(Value *Obj) {
+    return isa<AllocaInst>(Obj) || isa<GlobalVariable>(Obj) || isa<CallBase>(Obj) || isa<Argument>(Obj);
+}
+
+/// null, undef, functions and so on, which never hold data
+static bool isNoObject(Value *Obj) {
+    return isa<Constant>(Obj) && !isa<GlobalVariable>(Obj);
+}
+
+void MessageTaintAnalysis::getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.setPreservesAll();
+}
+
+bool MessageTaintAnalysis::runOnModule(Module &M) {
+    if (!EnableMessageTaint) return false;
+
+    collectSinkGlobals(M);
+    for (auto &F: M)
+        if (!F.isDeclaration() && F.hasAddressTaken()) AddressTakenFunctions.push_back(&F);
+
+    // the taint only grows, so the iteration terminates
+    bool Changed = true;
+    while (Changed) {
+        Changed = false;
+        for (auto &F: M)
+            for (auto &I: instructions(F))
+                Changed |= propagate(I);
+    }
+
+    // a function is message-free if itself is, and so are all its callees
+    unsigned NumFunctions = 0;
+    for (auto &F: M) {
+        if (F.isDeclaration()) continue;
+        ++NumFunctions;
+        if (locallyMessageFree(F)) MessageFreeFunctions.insert(&F);
+    }
+    Changed = true;
+    while (Changed) {
+        Changed = false;
+        for (auto It = MessageFreeFunctions.begin(); It != MessageFreeFunctions.end();) {
+            bool CallsOthers = false;
+            for (auto &I: instructions(*It)) {
+                auto *CI = dyn_cast<CallInst>(&I);
+                auto *Callee = CI ? CI->getCalledFunction() : nullptr;
+                if (Callee && !Callee->isDeclaration() && !MessageFreeFunctions.count(Callee)) {
+                    CallsOthers = true;
+                    break;
+                }
+            }
+            if (CallsOthers) {
+                It = MessageFreeFunctions.erase(It);
+                Changed = true;
+            } else {
+                ++It;
+            }
+        }
+    }
+    POPEYE_INFO("Message taint: " << MessageFreeFunctions.size() << " of " << NumFunctions
+                                  << " functions never touch the message");
+    ObjectMap.clear();
+    return false;
+}
+
+const SmallVectorImpl<Value *> &MessageTaintAnalysis::objects(Value *Ptr) const {
+    auto It = ObjectMap.find(Ptr);
+    if (It != ObjectMap.end()) return It->second;
+
+    SmallVector<const Value *, 2> Objs;
+    getUnderlyingObjects(Ptr, Objs, nullptr, 0);
+    auto &Ret = ObjectMap[Ptr];
+    for (auto *Obj: Objs) Ret.push_back(const_cast<Value *>(Obj));
+    return Ret;
+}
+
+bool MessageTaintAnalysis::tainted(Value *V) const {
+    if (TaintedValues.count(V)) return true;
+    if (!V->getType()->isPointerTy()) return false;
+
+    // a pointer is tainted if it may point to message-derived data
+    for (auto *Obj: objects(V)) {
+        if (isNoObject(Obj)) continue;
+        if (TaintedValues.count(Obj) || TaintedObjects.count(Obj)) return true;
+        if (!isIdentifiedObject(Obj) && TaintEscaped) return true;
+    }
+    return false;
+}
+
+bool MessageTaintAnalysis::taint(Value *V) {
+    return TaintedValues.insert(V).second;
+}
+
+bool MessageTaintAnalysis::taintObjects(Value *Ptr) {
+    bool Changed = false;
+    for (auto *Obj: objects(Ptr)) {
+        if (isNoObject(Obj)) continue;
+        if (auto *GV = dyn_cast<GlobalVariable>(Obj))
+            if (GV->isConstant()) continue;
+        if (isIdentifiedObject(Obj)) {
+            Changed |= TaintedObjects.insert(Obj).second;
+        } else if (!TaintEscaped) {
+            TaintEscaped = true;
+            Changed = true;
+        }
+    }
+    return Changed;
+}
+
+bool MessageTaintAnalysis::propagate(Instruction &I) {
+    if (auto *SI = dyn_cast<StoreInst>(&I)) {
+        return tainted(SI->getValueOperand()) && taintObjects(SI->getPointerOperand());
+    } else if (auto *LI = dyn_cast<LoadInst>(&I)) {
+        return tainted(LI->getPointerOperand()) && taint(LI);
+    } else if (auto *RMW = dyn_cast<AtomicRMWInst>(&I)) {
+        bool Changed = tainted(RMW->getValOperand()) && taintObjects(RMW->getPointerOperand());
+        return (tainted(RMW->getPointerOperand()) && taint(RMW)) || Changed;
+    } else if (auto *CmpXchg = dyn_cast<AtomicCmpXchgInst>(&I)) {
+        bool Changed = tainted(CmpXchg->getNewValOperand()) && taintObjects(CmpXchg->getPointerOperand());
+        return (tainted(CmpXchg->getPointerOperand()) && taint(CmpXchg)) || Changed;
+    } else if (auto *CI = dyn_cast<CallInst>(&I)) {
+        return propagateCall(*CI);
+    } else if (auto *RI = dyn_cast<ReturnInst>(&I)) {
+        auto *RetVal = RI->getReturnValue();
+        return RetVal && tainted(RetVal) && TaintedReturns.insert(RI->getFunction()).second;
+    } else if (!I.getType()->isVoidTy() && !TaintedValues.count(&I)) {
+        for (auto &Op: I.operands())
+            if (tainted(Op.get())) return taint(&I);
+    }
+    return false;
+}
+
+bool MessageTaintAnalysis::propagateCall(CallInst &I) {
+    if (isa<DbgInfoIntrinsic>(I) || I.isLifetimeStartOrEnd()) return false;
+
+    bool Changed = false;
+    auto *Callee = dyn_cast<Function>(I.getCalledOperand()->stripPointerCasts());
+    if (Callee && Callee->isDeclaration()) {
+        if (isMessageSource(Callee)) return taint(&I);
+
+        bool AnyTainted = false;
+        for (auto &Arg: I.args())
+            if (tainted(Arg.get())) AnyTainted = true;
+        if (!AnyTainted) return false;
+
+        // an external function may derive its return value or the memory it writes from the tainted arguments
+        if (!I.getType()->isVoidTy()) Changed |= taint(&I);
+        if (isMemoryWriter(Callee)) return taintObjects(I.getArgOperand(0)) || Changed;
+        for (auto &Arg: I.args())
+            if (Arg->getType()->isPointerTy()) Changed |= taintObjects(Arg.get());
+        return Changed;
+    }
+
+    // a direct call to a defined function, or an indirect call to any function whose address is taken
+    std::vector<Function *> Callees;
+    if (Callee) {
+        Callees.push_back(Callee);
+    } else if (!I.isInlineAsm()) {
+        Callees = AddressTakenFunctions;
+    }
+    for (auto *F: Callees) {
+        for (unsigned K = 0; K < F->arg_size() && K < I.arg_size(); ++K) {
+            auto *Formal = F->getArg(K);
+            auto *Actual = I.getArgOperand(K);
+            if (tainted(Actual)) Changed |= taint(Formal);
+            // the callee stores message-derived data to the memory the argument points to
+            if (TaintedObjects.count(Formal)) Changed |= taintObjects(Actual);
+        }
+        if (TaintedReturns.count(F)) Changed |= taint(&I);
+    }
+    return Changed;
+}
+
+void MessageTaintAnalysis::collectSinkGlobals(Module &M) {
+    for (auto &GV: M.globals()) {
+        bool Sink = true;
+        std::vector<Value *> WorkList;
+        for (auto *U: GV.users()) {
+            if (auto *SI = dyn_cast<StoreInst>(U)) {
+                if (SI->getPointerOperand() != &GV) Sink = false;
+            } else if (isa<LoadInst>(U)) {
+                WorkList.push_back(U);
+            } else {
+                Sink = false;
+            }
+        }
+        // the loaded value is only used to compute a new value of the global, e.g., Counter++,
+        // or passed to an external function the executor does not model, e.g., printf
+        DenseSet<Value *> Visited;
+        while (Sink && !WorkList.empty()) {
+            auto *V = WorkList.back();
+            WorkList.pop_back();
+            if (!Visited.insert(V).second) continue;
+            for (auto *U: V->users()) {
+                if (auto *SI = dyn_cast<StoreInst>(U)) {
+                    if (SI->getPointerOperand() != &GV) Sink = false;
+                } else if (isa<BinaryOperator>(U) || isa<CastInst>(U)) {
+                    WorkList.push_back(U);
+                } else if (auto *CI = dyn_cast<CallInst>(U)) {
+                    auto *Callee = CI->getCalledFunction();
+                    if (!Callee || !Callee->isDeclaration() || isBuiltIn(Callee) || isMemoryWriter(Callee))
+                        Sink = false;
+                } else {
+                    Sink = false;
+                }
+            }
+        }
+        if (Sink) SinkGlobals.insert(&GV);
+    }
+}
+
+bool MessageTaintAnalysis::locallyMessageFree(Function &F) const {
+    if (isBuiltIn(&F)) return false;
+    for (auto &Arg: F.args())
+        if (tainted(&Arg)) return false;
+
+    for (auto &I: instructions(F)) {
+        if (isa<DbgInfoIntrinsic>(I) || I.isLifetimeStartOrEnd()) continue;
+        if (TaintedValues.count(&I)) return false;
+        for (auto &Op: I.operands())
+            if (tainted(Op.get())) return false;
+
+        if (auto *SI = dyn_cast<StoreInst>(&I)) {
+            if (writesVisibleMemory(I, SI->getPointerOperand())) return false;
+        } else if (auto *RMW = dyn_cast<AtomicRMWInst>(&I)) {
+            if (writesVisibleMemory(I, RMW->getPointerOperand())) return false;
+        } else if (auto *CmpXchg = dyn_cast<AtomicCmpXchgInst>(&I)) {
+            if (writesVisibleMemory(I, CmpXchg->getPointerOperand())) return false;
+        } else if (auto *CI = dyn_cast<CallInst>(&I)) {
+            // the executor may resolve an indirect call to any function
+            auto *Callee = CI->getCalledFunction();
+            if (!Callee) return false;
+            if (Callee->isDeclaration()) {
+                if (isBuiltIn(Callee)) return false;
+                if (isMemoryWriter(Callee) && writesVisibleMemory(I, CI->getArgOperand(0))) return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool MessageTaintAnalysis::writesVisibleMemory(Instruction &I, Value *Ptr) const {
+    for (auto *Obj: objects(Ptr)) {
+        if (isNoObject(Obj)) continue;
+        if (auto *Alloca = dyn_cast<AllocaInst>(Obj)) {
+            if (Alloca->getFunction() == I.getFunction()) continue;
+        } else if (auto *GV = dyn_cast<GlobalVariable>(Obj)) {
+            if (SinkGlobals.count(GV)) continue;
+        }
+        return true;
+    }
+    return false;
+}
@@ -18,11 +18,14 @@
 
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Debug.h>
-#include <llvm/Support/MD5.h>
+#include <unordered_map>
 #include "Core/SliceGraph.h"
 #include "Support/ADT.h"
 #include "Support/Debug.h"
 #include "Support/Dot.h"
+#include "Support/HashCons.h"
+#include "Support/Persistent.h"
+#include "Support/Profiler.h"
 
 #define DEBUG_TYPE "SliceGraph"
 
@@ -97,7 +100,7 @@ SliceGraph *SliceGraph::getOr(const z3::expr &Or) {
         auto *G = getUnknown(Or.arg(I));
         auto *GRoot = new SliceGraphNode(Z3::bool_val(true));
         if (PhiCondID.count(Z3::id(Or.arg(I)))) {
-            GRoot->setConditionID(Z3::id(Or.arg(I)));
+            GRoot->setConditionID(Or.arg(I));
         }
         for (auto *X: G->Entries) {
             X->Parents.insert(GRoot);
@@ -391,6 +394,7 @@ void SliceGraph::remove(SliceGraphNode *N, bool PreserveReachability, std::set<S
 }
 
 void SliceGraph::simplifyAfterSymbolicExecution() {
+    ProfileScope Scope("slice", "simplifyAfterSymbolicExecution");
     // simplifying formulas in each node
     simplifyByRewriting();
 
@@ -407,14 +411,16 @@ void SliceGraph::simplifyAfterSymbolicExecution() {
 }
 
 void SliceGraph::simplifyByRewriting() {
+    ProfileScope Scope("slice", "simplifyByRewriting");
     dfs([this](SliceGraphNode *N) {
         auto Expr = simplify(N->getCondition()).simplify();
         N->setCondition(Expr);
-        N->setConditionID(Z3::id(Expr));
+        N->setConditionID(Expr);
     });
 }
 
 void SliceGraph::simplifyByRemovingNoSelect() {
+    ProfileScope Scope("slice", "simplifyByRemovingNoSelect");
     auto NotRelated = [](SliceGraphNode *Node) {
         return !Z3::find(Node->getCondition(), [](const z3::expr &E) {
             return E.decl().decl_kind() == Z3_OP_SELECT;
@@ -444,6 +450,7 @@ void SliceGraph::simplifyByRemovingNoSelect() {
 }
 
 void SliceGraph::simplifyByRemoving() {
+    ProfileScope Scope("slice", "simplifyByRemoving");
     auto NotRelated = [](SliceGraphNode *Node) {
         auto Expr = Node->getCondition();
         bool Useful = Z3::find(Expr, [](const z3::expr &E) {
@@ -502,6 +509,7 @@ void SliceGraph::simplifyByRemoving() {
 }
 
 void SliceGraph::simplifyByMerging() {
+    ProfileScope Scope("slice", "simplifyByMerging");
     std::set<SliceGraphNode *> Deleted;
     std::set<SliceGraphNode *> Visited;
     dfs([&Visited](SliceGraphNode *N) {
@@ -610,37 +618,31 @@ void SliceGraph::simplifyByMerging() {
 }
 
 void SliceGraph::simplifyByHashConsing() {
+    ProfileScope Scope("slice", "simplifyByHashConsing");
     std::vector<SliceGraphNode *> Topo;
     topoOrder(Topo);
-
-    // bottom-up to compute hash and merge those having the same hash
-    std::map<SliceGraphNode *, std::string> NodeHashMap;
-    std::map<std::string, SliceGraphNode *> HashNodeMap;
-    std::set<std::string> Children;
+    std::unordered_map<SliceGraphNode *, unsigned> TopoIndexMap;
+    for (unsigned I = 0; I < Topo.size(); ++I) TopoIndexMap[Topo[I]] = I;
+
+    // bottom-up to compute the structural id and merge those having the same id
+    HashConsTable Table;
+    std::vector<unsigned> NodeIDVec(Topo.size());
+    std::vector<SliceGraphNode *> IDNodeVec;
+    std::vector<unsigned> Children;
     for (unsigned I = Topo.size(); I > 0; --I) {
         auto *N = Topo[I - 1];
 
-        std::string Str = std::to_string(N->getConditionID());
         Children.clear();
         for (auto *Ch: N->Children) {
-            Children.insert(NodeHashMap[Ch]);
-        }
-        for (auto &Ch: Children) {
-            Str.append(".").append(Ch);
+            Children.push_back(NodeIDVec[TopoIndexMap.at(Ch)]);
         }
-
-        MD5 Hash;
-        Hash.update(Str);
-        MD5::MD5Result Res;
-        Hash.final(Res);
-        auto Digest = Res.digest().str().str();
-        NodeHashMap[N] = Digest;
-        auto It = HashNodeMap.find(Digest);
-        if (It == HashNodeMap.end()) {
-            HashNodeMap[Digest] = N;
+        auto Res = Table.insert(N->getConditionID(), Children);
+        NodeIDVec[I - 1] = Res.first;
+        if (Res.second) {
+            IDNodeVec.push_back(N);
         } else {
             // merge, N's all parents should connect to SameHashNode
-            auto *SameHashNode = It->second;
+            auto *SameHashNode = IDNodeVec[Res.first];
             for (auto *NParent: N->Parents) {
                 NParent->Children.insert(SameHashNode);
                 SameHashNode->Parents.insert(NParent);
@@ -669,6 +671,7 @@ static bool isFree(const z3::expr &E) {
 }
 
 void SliceGraph::simplifyBeforeSymbolicExecution() {
+    ProfileScope Scope("slice", "simplifyBeforeSymbolicExecution");
     // step 1
     std::set<SliceGraphNode *> Visited;
     dfs([&Visited](SliceGraphNode *N) {
@@ -909,50 +912,116 @@ z3::expr SliceGraph::pc() {
 
 z3::expr_vector SliceGraph::collectConstraints(SliceGraphNode *From, std::vector<SliceGraphNode *> &Tos,
                                                bool ExFrom) const {
+    std::unordered_map<SliceGraphNode *, std::vector<unsigned>> ToMap;
+    for (unsigned K = 0; K < Tos.size(); ++K) ToMap[Tos[K]].push_back(K);
+
     auto RetVec = Z3::vec();
-    if (Tos.empty()) return RetVec;
+    for (unsigned K = 0; K < Tos.size(); ++K) RetVec.push_back(Z3::bool_val(true));
+    auto Found = collectConstraints({From}, [&ToMap](unsigned, SliceGraphNode *N) { return ToMap.count(N); }, ExFrom);
+    for (auto &It: Found[0]) {
+        for (auto K: ToMap.at(It.first)) RetVec.set(K, It.second);
+    }
+    return RetVec;
+}
 
-    std::set<SliceGraphNode *> ForwardSlice;
-    dfs([&ForwardSlice](SliceGraphNode *Node) { ForwardSlice.insert(Node); }, From);
+std::vector<std::vector<std::pair<SliceGraphNode *, z3::expr>>>
+SliceGraph::collectConstraints(const std::vector<SliceGraphNode *> &Froms,
+                               const std::function<bool(unsigned, SliceGraphNode *)> &IsTarget, bool ExFrom) const {
+    ProfileScope Scope("slice", "collectConstraints");
+    std::vector<std::vector<std::pair<SliceGraphNode *, z3::expr>>> RetVecs(Froms.size());
 
     // compute the reverse post order vector
     std::vector<SliceGraphNode *> ReversePostOrder;
     postOrder(ReversePostOrder);
     std::reverse(ReversePostOrder.begin(), ReversePostOrder.end());
+    std::unordered_map<SliceGraphNode *, unsigned> OrderMap;
+    for (unsigned I = 0; I < ReversePostOrder.size(); ++I) OrderMap[ReversePostOrder[I]] = I;
 
     // traverse the post order vector, when merging, pull the common prefix out
-    typedef std::vector<z3::expr> PrevCondition;
-    std::map<SliceGraphNode *, std::vector<PrevCondition>> InVec;
-    if (ExFrom) {
-        for (auto *C: From->Children) {
-            auto &Vec = InVec[C];
-            Vec.emplace_back();
-            Vec.back().push_back(Z3::bool_val(true));
+    // a node keeps the incoming condition lists of every source reaching it, they are released once the node is
+    // visited. the lists are persistent, so a list extended by a node shares its prefix with the list it extends, and
+    // the sources reaching a node by the same lists share the merged list, its extension, and its conjunction.
+    typedef PersistentVector<z3::expr> PrevCondition;
+    std::vector<std::map<unsigned, std::vector<PrevCondition>>> InVec(ReversePostOrder.size());
+    PrevCondition Init;
+    Init.push_back(Z3::bool_val(true));
+    for (unsigned K = 0; K < Froms.size(); ++K) {
+        auto *From = Froms[K];
+        if (ExFrom) {
+            for (auto *C: From->Children) InVec[OrderMap.at(C)][K].push_back(Init);
+        } else {
+            InVec[OrderMap.at(From)][K].push_back(Init);
         }
-        ForwardSlice.erase(From);
-    } else {
-        auto &Vec = InVec[From];
-        Vec.emplace_back();
-        Vec.back().push_back(Z3::bool_val(true));
     }
 
-    for (auto *Node: ReversePostOrder) {
-        if (!ForwardSlice.count(Node) || Node->Children.empty()) continue;
+    for (unsigned I = 0; I < ReversePostOrder.size(); ++I) {
+        auto *Node = ReversePostOrder[I];
+        auto &SourceMap = InVec[I];
+        if (SourceMap.empty()) continue;
+
+        // the ids of the incoming lists -> the merged list
+        std::map<std::vector<const void *>, PrevCondition> MergedMap;
+        // the id of a merged list -> the list extended by the condition of this node, and the conjunction of the list
+        std::map<const void *, PrevCondition> ExtendedMap;
+        std::map<const void *, z3::expr> ConjunctionMap;
+        for (auto &It: SourceMap) {
+            auto Source = It.first;
+            auto &PrevCondVec = It.second;
+            bool Target = IsTarget(Source, Node);
+            if (!Target && Node->Children.empty()) continue;
+
+            std::vector<const void *> Key;
+            for (auto &PrevCond: PrevCondVec) Key.push_back(PrevCond.id());
+            std::sort(Key.begin(), Key.end());
+            Key.erase(std::unique(Key.begin(), Key.end()), Key.end());
+
+            auto MergedIt = MergedMap.find(Key);
+            if (MergedIt == MergedMap.end()) {
+                PrevCondition Merged;
+                if (Key.size() == 1) {
+                    Merged = PrevCondVec[0];
+                } else {
+                    // merge pulls the common prefix out, so only the elements after the shared nodes are merged,
+                    // except the last element of a list, which is never pulled out
+                    Merged = PrevCondVec[0];
+                    for (auto &PrevCond: PrevCondVec) Merged = Merged.sharedPrefix(PrevCond);
+                    for (auto &PrevCond: PrevCondVec) {
+                        if (PrevCond.size() != Merged.size()) continue;
+                        Merged.pop_back();
+                        break;
+                    }
+                    std::vector<std::vector<z3::expr>> Vecs;
+                    for (auto &PrevCond: PrevCondVec) {
+                        Vecs.emplace_back();
+                        for (auto K = Merged.size(); K < PrevCond.size(); ++K) Vecs.back().push_back(PrevCond[K]);
+                    }
+                    for (auto &E: merge(Vecs)) Merged.push_back(E);
+                }
+                MergedIt = MergedMap.emplace(std::move(Key), std::move(Merged)).first;
+            }
+            auto &PrevCond = MergedIt->second;
 
-        auto &PrevCondVec = InVec[Node];
-        PrevCondition PrevCond = merge(PrevCondVec);
-        for (auto *Ch: Node->Children) {
-            auto &ChInVec = InVec[Ch];
-            ChInVec.push_back(PrevCond);
-            ChInVec.back().push_back(Node->getCondition());
+            if (Target) {
+                auto ConjunctionIt = ConjunctionMap.find(PrevCond.id());
+                if (ConjunctionIt == ConjunctionMap.end()) {
+                    auto Conjunction = Z3::make_and(std::vector<z3::expr>(PrevCond.begin(), PrevCond.end()));
+                    ConjunctionIt = ConjunctionMap.emplace(PrevCond.id(), Conjunction).first;
+                }
+                RetVecs[Source].emplace_back(Node, ConjunctionIt->second);
+            }
+            if (Node->Children.empty()) continue;
+
+            auto ExtendedIt = ExtendedMap.find(PrevCond.id());
+            if (ExtendedIt == ExtendedMap.end()) {
+                auto Extended = PrevCond;
+                Extended.push_back(Node->getCondition());
+                ExtendedIt = ExtendedMap.emplace(PrevCond.id(), std::move(Extended)).first;
+            }
+            for (auto *Ch: Node->Children) InVec[OrderMap.at(Ch)][Source].push_back(ExtendedIt->second);
         }
+        std::map<unsigned, std::vector<PrevCondition>>().swap(SourceMap);
     }
-    for (auto *To: Tos) {
-        auto &PrevCondVec = InVec[To];
-        PrevCondition PrevCond = merge(PrevCondVec);
-        RetVec.push_back(Z3::make_and(PrevCond));
-    }
-    return RetVec;
+    return RetVecs;
 }
 
 void SliceGraph::removeFrom(SliceGraphNode *N, std::set<SliceGraphNode *> &Removed) {
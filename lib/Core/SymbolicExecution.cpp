@@ -16,8 +16,17 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <llvm/ADT/ScopeExit.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Debug.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "Core/SymbolicExecution.h"
 #include "Support/TimeRecorder.h"
 
@@ -27,60 +36,306 @@ using namespace llvm;
 
 static cl::opt<bool> SEDefense("popeye-enable-safe-se", cl::desc("enable safe se"), cl::init(false));
 
-static void select(std::map<unsigned, std::vector<unsigned>>::iterator It,
-                   std::map<unsigned, std::vector<unsigned>>::iterator End,
-                   PushPopVector<PhiPointer> &Combo,
-                   SliceGraphNode *Node,
-                   std::vector<std::pair<SliceGraphNode *, std::vector<PhiPointer>>> &Ret) {
-    Combo.push();
-
-    if (It != End) {
-        auto ItCopy = It;
-        ItCopy++;
-        for (auto Y: It->second) {
-            Combo.push();
-            Combo.push_back({It->first, Y});
-            select(ItCopy, End, Combo, Node, Ret);
-            Combo.pop();
-        }
-    } else {
-        Ret.emplace_back(Node, Combo.get());
+static cl::opt<bool> SESolver("popeye-enable-se-solver",
+                              cl::desc("prune infeasible paths in se using the incremental solver"),
+                              cl::init(false));
+
+static cl::opt<bool> SEMemo("popeye-enable-se-memo",
+                            cl::desc("share the explored subtree of a slice node reached again in an equivalent state"),
+                            cl::init(false));
+
+static cl::opt<unsigned> SEThreads("popeye-se-threads",
+                                   cl::desc("the number of threads exploring the symbolic execution tree"),
+                                   cl::init(1));
+
+static cl::opt<unsigned> SETimeout("popeye-se-timeout",
+                                   cl::desc("stop expanding the symbolic execution tree after the given seconds, "
+                                            "0 means no limit"),
+                                   cl::init(0));
+
+static cl::opt<unsigned> SEMaxNodes("popeye-se-max-nodes",
+                                    cl::desc("stop expanding the symbolic execution tree after creating the given "
+                                             "number of nodes, 0 means no limit"),
+                                    cl::init(0));
+
+static cl::opt<unsigned> MaxRSS("popeye-max-rss",
+                                cl::desc("stop expanding the symbolic execution tree once the resident set size "
+                                         "exceeds the given megabytes, 0 means no limit"),
+                                cl::init(0));
+
+namespace {
+/// a graph node seen by a worker, whose exprs are translated into the context of the worker
+struct TranslatedNode {
+    z3::expr Condition;
+    /// kept to pin the id
+    z3::expr Identity;
+};
+}
+
+namespace {
+/// a forked subtree and where to link it
+struct Stitch {
+    /// the order in which the subtree is forked
+    unsigned Seq;
+    SymbolicExecutionTreeNode *Parent;
+    SymbolicExecutionTreeNode *Root;
+};
+}
+
+/// the state shared by the tasks of a parallel run
+struct SymbolicExecutionTasks {
+    WorkStealingPool Pool;
+
+    std::map<unsigned, std::vector<unsigned>> PhiID2DupValIDMap;
+
+    /// worker -> the graph nodes seen by the worker
+    std::vector<std::unordered_map<SliceGraphNode *, TranslatedNode>> TranslatedNodeMaps;
+
+    /// linked in the order of Seq after all tasks are finished
+    std::atomic<unsigned> NumForked{0};
+    std::mutex StitchLock;
+    std::vector<Stitch> Stitches;
+    unsigned NumSubtreeShared = 0;
+
+    SymbolicExecutionBudget *Budget = nullptr;
+
+    SymbolicExecutionTasks(unsigned NumThreads) : Pool(NumThreads), TranslatedNodeMaps(Pool.size()) {}
+
+    /// link the forked subtrees to their parents, call it only if all tasks are finished
+    void stitch() {
+        std::sort(Stitches.begin(), Stitches.end(), [](const Stitch &A, const Stitch &B) { return A.Seq < B.Seq; });
+        for (auto &S: Stitches) S.Parent->addChild(S.Root);
+        Stitches.clear();
     }
+};
+
+/// the budgets of a run. once one of them is exhausted, every frontier left is closed conservatively, i.e., its
+/// subtree is replaced by an exit so that the path condition only keeps the constraints explored so far.
+struct SymbolicExecutionBudget {
+    std::chrono::steady_clock::time_point Deadline;
+    std::atomic<unsigned> NumNodes{0};
+    /// the node count at which the rss is sampled next
+    std::atomic<unsigned> NextRSSSample{0};
+    /// null if no budget is exhausted
+    std::atomic<const char *> Exhausted{nullptr};
+
+    /// the graph nodes whose subtrees are not explored
+    std::mutex CutOffLock;
+    std::set<SliceGraphNode *> CutOff;
+
+    SymbolicExecutionBudget() : Deadline(std::chrono::steady_clock::now() + std::chrono::seconds(SETimeout)) {}
+
+    void cutOff(SliceGraphNode *Node) {
+        std::lock_guard<std::mutex> L(CutOffLock);
+        CutOff.insert(Node);
+    }
+};
+
+/// the current resident set size in megabytes, rather than the peak, which may be reached before this step
+static size_t currentRSS() {
+    auto *File = fopen("/proc/self/statm", "r");
+    if (!File) return 0;
+    unsigned long Size = 0, Resident = 0;
+    int Num = fscanf(File, "%lu %lu", &Size, &Resident);
+    fclose(File);
+    if (Num != 2) return 0;
+    return Resident * (size_t) sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
 
-    Combo.pop();
+/// the incremental solver depends on the whole path, thus subtrees are not shared with it
+static bool memoizing() {
+    return SEMemo && !SESolver;
 }
 
-SymbolicExecutionTree *SymbolicExecution::run(const z3::expr &PC, SliceGraph &SG) {
-    findDupPhiVal(PC);
-    auto *FakeRoot = new SymbolicExecutionTreeNode();
-    auto *Tree = new SymbolicExecutionTree(FakeRoot);
+static bool intersects(const std::vector<unsigned> &A, const std::vector<unsigned> &B) {
+    auto AIt = A.begin();
+    auto BIt = B.begin();
+    while (AIt != A.end() && BIt != B.end()) {
+        if (*AIt < *BIt) ++AIt;
+        else if (*BIt < *AIt) ++BIt;
+        else return true;
+    }
+    return false;
+}
+
+template<typename T>
+static void sortAndUnique(std::vector<T> &Vec) {
+    std::sort(Vec.begin(), Vec.end());
+    Vec.erase(std::unique(Vec.begin(), Vec.end()), Vec.end());
+}
+
+/// yield the cartesian product of the phi selections one combination at a time, instead of materializing it.
+/// a selected value is only reachable under the condition of its incoming edge, so a value whose condition
+/// conflicts with the condition of a value selected for a former phi is skipped together with all combinations
+/// extending the partial selection.
+class SymbolicExecution::PhiCombinations {
+private:
+    struct Choice {
+        unsigned Selected;
+        /// true if the condition is unknown or not named in the path, which never conflicts
+        z3::expr Cond;
+    };
+
+    std::vector<std::pair<unsigned, std::vector<Choice>>> Phis;
+    /// the index of the current choice of each phi
+    std::vector<unsigned> Cursor;
+    bool Started = false;
+    bool Done = false;
+
+public:
+    PhiCombinations(SymbolicExecution &SE, const std::map<unsigned, std::vector<unsigned>> &PhiSelectionMap) {
+        for (auto &It: PhiSelectionMap) {
+            auto PhiID = It.first;
+            auto CondVec = Z3::phi_cond(PhiID);
+            Phis.emplace_back(PhiID, std::vector<Choice>());
+            auto &Choices = Phis.back().second;
+            for (auto Selected: It.second) {
+                auto Cond = Z3::bool_val(true);
+                if (Selected < CondVec.size() && SE.NamedElementStack.contains(Z3::id(CondVec[Selected])))
+                    Cond = CondVec[Selected];
+                Choices.push_back({Selected, Cond});
+            }
+        }
+    }
+
+    /// return false if all combinations have been enumerated
+    bool next(std::vector<PhiPointer> &Ret) {
+        if (Done) return false;
+        if (Phis.empty()) {
+            Done = true;
+            Ret.clear();
+            return true;
+        }
+
+        unsigned D;
+        if (!Started) {
+            Started = true;
+            Cursor.assign(Phis.size(), 0);
+            D = 0;
+        } else {
+            D = Phis.size() - 1;
+            ++Cursor[D];
+        }
+
+        while (true) {
+            if (Cursor[D] == Phis[D].second.size()) {
+                if (D == 0) {
+                    Done = true;
+                    return false;
+                }
+                ++Cursor[--D];
+                continue;
+            }
+            if (conflictsWithSelection(D)) {
+                ++Cursor[D];
+                continue;
+            }
+            if (D + 1 == Phis.size()) break;
+            Cursor[++D] = 0;
+        }
 
-    std::vector<std::pair<SliceGraphNode *, std::vector<PhiPointer>>> EntryStateVec;
-    for (auto EntryIt = SG.entry_begin(), E = SG.entry_end(); EntryIt != E; ++EntryIt) {
-        auto *Entry = *EntryIt;
-        std::map<unsigned, std::vector<unsigned>> PhiSelectionMap; // phi_id -> possible value index
-        evaluatePhi(Entry, PhiSelectionMap);
+        Ret.clear();
+        for (unsigned K = 0; K < Phis.size(); ++K) {
+            Ret.push_back({Phis[K].first, Phis[K].second[Cursor[K]].Selected});
+        }
+        return true;
+    }
 
-        PushPopVector<PhiPointer> Combination;
-        auto It = PhiSelectionMap.begin();
-        select(It, PhiSelectionMap.end(), Combination, Entry, EntryStateVec);
+private:
+    bool conflictsWithSelection(unsigned D) {
+        auto &Cond = Phis[D].second[Cursor[D]].Cond;
+        if (Cond.is_true()) return false;
+        for (unsigned K = 0; K < D; ++K) {
+            auto &Former = Phis[K].second[Cursor[K]].Cond;
+            if (!Former.is_true() && Z3::simplify(Former, Cond).is_false()) return true;
+        }
+        return false;
     }
+};
 
-    for (auto &State: EntryStateVec) {
-        doSymbolicExecutionDFS(FakeRoot, State.first, State.second);
+SymbolicExecutionTree *SymbolicExecution::run(const z3::expr &PC, SliceGraph &SG) {
+    findDupPhiVal(PC);
+    auto *FakeRoot = new SymbolicExecutionTreeNode();
+    std::unique_ptr<SymbolicExecutionTree> Tree(new SymbolicExecutionTree(FakeRoot));
+    SymbolicExecutionBudget RunBudget;
+    Budget = &RunBudget;
+
+    std::unique_ptr<SymbolicExecutionTasks> Parallel;
+    // if the run throws, the tasks are finished before the locals they use are gone, the forked subtrees are
+    // released with the tree, and the members do not point to the locals any more
+    auto Cleanup = make_scope_exit([this, &Parallel]() {
+        if (Parallel) {
+            try {
+                Parallel->Pool.wait();
+            } catch (...) {
+                // the first exception is being propagated
+            }
+            Parallel->stitch();
+        }
+        Tasks = nullptr;
+        Budget = nullptr;
+        PhiSelectorStack.reset();
+        EliminatePhiMemo.reset();
+        BNFExecutionPath.reset();
+        PhiSelectorPath.reset();
+        NamedElementStack.reset();
+        PathCondStack.reset();
+        PathCondAtomStack.reset();
+    });
+    if (SEThreads > 1) {
+        Parallel.reset(new SymbolicExecutionTasks(SEThreads));
+        Parallel->PhiID2DupValIDMap = PhiID2DupValIDMap;
+        Parallel->Budget = Budget;
+        Tasks = Parallel.get();
+    }
+    {
+        // the tasks translate the exprs of the graph from the context of this thread, which is thus locked while
+        // this thread enumerates the combinations, the tasks forked meanwhile start after the dispatch
+        std::unique_ptr<Z3::TranslationLock> Lock(Tasks ? new Z3::TranslationLock : nullptr);
+        for (auto EntryIt = SG.entry_begin(), E = SG.entry_end(); EntryIt != E; ++EntryIt) {
+            auto *Entry = *EntryIt;
+            std::map<unsigned, std::vector<unsigned>> PhiSelectionMap; // phi_id -> possible value index
+            evaluatePhi(Entry, PhiSelectionMap);
+
+            PhiCombinations Combinations(*this, PhiSelectionMap);
+            std::vector<PhiPointer> Combination;
+            while (Combinations.next(Combination)) {
+                visit(FakeRoot, Entry, Combination);
+            }
+        }
+    }
+    if (Tasks) {
+        Tasks->Pool.wait();
+        Tasks = nullptr;
+
+        // the workers are idle now, so their contexts can be read to move the tree to the main thread
+        Parallel->stitch();
+        NumSubtreeShared += Parallel->NumSubtreeShared;
+        Tree->dfs([](SymbolicExecutionTreeNode *N) { N->setExpr(Z3::translate(N->getExpr())); });
     }
 
-    PhiSelectorStack.reset();
-    BNFExecutionPath.reset();
-    NamedElementStack.reset();
-    PathCondStack.reset();
-    return Tree;
+    if (NumSubtreeShared) POPEYE_INFO("Symbolic execution memo: " << NumSubtreeShared << " subtrees shared!");
+    if (auto *Reason = RunBudget.Exhausted.load()) {
+        POPEYE_INFO("Symbolic execution stopped by " << Reason << " after " << RunBudget.NumNodes << " nodes, "
+                                                     << RunBudget.CutOff.size() << " slice nodes cut off:");
+        std::vector<SliceGraphNode *> CutOff(RunBudget.CutOff.begin(), RunBudget.CutOff.end());
+        std::sort(CutOff.begin(), CutOff.end(), [](SliceGraphNode *A, SliceGraphNode *B) {
+            return A->getConditionID() < B->getConditionID();
+        });
+        for (auto *Node: CutOff) {
+            auto Str = Node->getHint();
+            if (Str.empty()) Str = Z3::to_string(Node->getCondition(), true);
+            if (Str.length() > 100) Str = Str.substr(0, 100) + "...";
+            POPEYE_INFO("    $" << Node->getConditionID() << ": " << Str);
+        }
+    }
+    return Tree.release();
 }
 
 void SymbolicExecution::evaluatePhi(SliceGraphNode *Node, std::map<unsigned int, std::vector<unsigned int>> &Ret) {
     std::set<unsigned> Visited;
     std::vector<z3::expr> Stack;
-    Stack.push_back(Node->getCondition());
+    Stack.push_back(condition(Node));
     while (!Stack.empty()) {
         auto Top = Stack.back();
         Stack.pop_back();
@@ -141,57 +396,293 @@ void SymbolicExecution::evaluatePhi(SliceGraphNode *Node, std::map<unsigned int,
     }
 }
 
-void SymbolicExecution::doSymbolicExecutionDFS(SymbolicExecutionTreeNode *PrevTreeNode, SliceGraphNode *CurrGraphNode,
-                                               std::vector<PhiPointer> &PhiSelectors) {
+z3::expr SymbolicExecution::condition(SliceGraphNode *Node) {
+    // the main thread works in the context of the graph
+    if (!Tasks || WorkStealingPool::currentWorker() < 0) return Node->getCondition();
+
+    auto &NodeMap = Tasks->TranslatedNodeMaps[WorkStealingPool::currentWorker()];
+    auto It = NodeMap.find(Node);
+    if (It == NodeMap.end()) {
+        TranslatedNode TN{Z3::translate(Node->getCondition()), Z3::translate(Node->getIdentity())};
+        It = NodeMap.emplace(Node, TN).first;
+    }
+    return It->second.Condition;
+}
+
+unsigned SymbolicExecution::conditionID(SliceGraphNode *Node) {
+    if (!Tasks || WorkStealingPool::currentWorker() < 0) return Node->getConditionID();
+
+    condition(Node);
+    return Z3::id(Tasks->TranslatedNodeMaps[WorkStealingPool::currentWorker()].at(Node).Identity);
+}
+
+void SymbolicExecution::visit(SymbolicExecutionTreeNode *Parent, SliceGraphNode *GraphNode,
+                              const std::vector<PhiPointer> &PhiSelectors) {
+    // the main thread only dispatches the entries, and a worker forks a subtree only if another worker is starving
+    if (!Tasks || (WorkStealingPool::currentWorker() >= 0 && !Tasks->Pool.hungry())) {
+        doSymbolicExecutionDFS(Parent, GraphNode, PhiSelectors);
+        return;
+    }
+
+    // the subtrees are independent after the fork point, but the stacks keep exprs of the context of this thread,
+    // so the forked task rebuilds them in its own context by replaying the path to the fork point
+    std::vector<std::pair<SliceGraphNode *, std::vector<PhiPointer>>> Path;
+    for (unsigned K = 0; K < BNFExecutionPath.size(); ++K) {
+        Path.emplace_back(BNFExecutionPath[K], *PhiSelectorPath[K]);
+    }
+    auto *Shared = Tasks;
+    unsigned Seq = Tasks->NumForked++;
+    Tasks->Pool.submit([Shared, Seq, Parent, GraphNode, PhiSelectors, Path]() {
+        SymbolicExecution Task;
+        Task.Tasks = Shared;
+        Task.Budget = Shared->Budget;
+        Task.PhiID2DupValIDMap = Shared->PhiID2DupValIDMap;
+        for (auto &Step: Path) {
+            auto Expr = Task.enter(Step.first, Step.second);
+            if (SESolver && !Expr.is_true() && !Z3::is_naming_eq(Expr)) Z3Solver::add(Expr);
+        }
+        auto *Root = Task.doSymbolicExecutionDFS(nullptr, GraphNode, PhiSelectors);
+        for (unsigned K = 0; K < Path.size(); ++K) Task.leave();
+
+        std::lock_guard<std::mutex> L(Shared->StitchLock);
+        Shared->Stitches.push_back({Seq, Parent, Root});
+        Shared->NumSubtreeShared += Task.NumSubtreeShared;
+    });
+}
+
+z3::expr SymbolicExecution::enter(SliceGraphNode *CurrGraphNode, const std::vector<PhiPointer> &PhiSelectors) {
     PhiSelectorStack.push();
+    EliminatePhiMemo.push();
     BNFExecutionPath.push();
+    PhiSelectorPath.push();
     NamedElementStack.push();
     PathCondStack.push();
-    LLVM_DEBUG(dbgs() << "[SE] Visit: " << CurrGraphNode->getCondition() << "\n");
+    PathCondAtomStack.push();
+    if (SESolver) Z3Solver::push(); // the solver scopes mirror PathCondStack
+    LLVM_DEBUG(dbgs() << "[SE] Visit: " << condition(CurrGraphNode) << "\n");
 
-    auto *CurrTreeNode = new SymbolicExecutionTreeNode;
-    PrevTreeNode->addChild(CurrTreeNode);
     BNFExecutionPath.push_back(CurrGraphNode);
-    NamedElementStack.add(CurrGraphNode->getConditionID());
+    PhiSelectorPath.push_back(&PhiSelectors);
+    NamedElementStack.add(conditionID(CurrGraphNode));
     for (auto &Selector: PhiSelectors) PhiSelectorStack.add(Selector);
 
     // simplify and eliminate phi according to phi selectors
-    auto SimplifiedExpr = doSymbolicExecutionSimplify(CurrGraphNode->getCondition());
+    auto SimplifiedExpr = doSymbolicExecutionSimplify(condition(CurrGraphNode));
     PathCondStack.push_back(SimplifiedExpr);
+    if (memoizing()) {
+        std::vector<unsigned> Atoms;
+        Z3::atoms(SimplifiedExpr, Atoms);
+        sortAndUnique(Atoms);
+        PathCondAtomStack.push_back(Atoms);
+    }
     LLVM_DEBUG(dbgs() << "[SE] \tSimplified: " << SimplifiedExpr << "\n");
+    return SimplifiedExpr;
+}
+
+void SymbolicExecution::leave() {
+    if (SESolver) Z3Solver::pop();
+    PathCondAtomStack.pop();
+    PathCondStack.pop();
+    NamedElementStack.pop();
+    PhiSelectorStack.pop();
+    EliminatePhiMemo.pop();
+    PhiSelectorPath.pop();
+    BNFExecutionPath.pop();
+}
+
+/// reading the rss is a system call, thus it is sampled every 256 nodes. the workers share the node count and
+/// may skip any given value of it, so the one passing the threshold first takes the sample and moves the threshold
+static bool sampleRSS(SymbolicExecutionBudget *Budget, unsigned NumNodes) {
+    unsigned Next = Budget->NextRSSSample.load(std::memory_order_relaxed);
+    return NumNodes >= Next && Budget->NextRSSSample.compare_exchange_strong(Next, NumNodes + 256);
+}
+
+bool SymbolicExecution::exhausted() {
+    if (Budget->Exhausted.load(std::memory_order_relaxed)) return true;
+
+    const char *Reason = nullptr;
+    unsigned NumNodes = Budget->NumNodes;
+    if (SEMaxNodes && NumNodes >= SEMaxNodes) {
+        Reason = "-popeye-se-max-nodes";
+    } else if (SETimeout && std::chrono::steady_clock::now() >= Budget->Deadline) {
+        Reason = "-popeye-se-timeout";
+    } else if (MaxRSS && sampleRSS(Budget, NumNodes) && currentRSS() >= MaxRSS) {
+        Reason = "-popeye-max-rss";
+    }
+    if (!Reason) return false;
+
+    const char *Expected = nullptr;
+    Budget->Exhausted.compare_exchange_strong(Expected, Reason);
+    return true;
+}
+
+SymbolicExecutionTreeNode *SymbolicExecution::doSymbolicExecutionDFS(SymbolicExecutionTreeNode *PrevTreeNode,
+                                                                     SliceGraphNode *CurrGraphNode,
+                                                                     const std::vector<PhiPointer> &PhiSelectors) {
+    // only a node with multiple parents can be reached again, and the same state yields the same subtree
+    std::vector<unsigned> Key;
+    auto Pins = Z3::vec();
+    bool Memoizable = memoizing() && CurrGraphNode->getNumParents() > 1 &&
+                      subtreeKey(CurrGraphNode, PhiSelectors, Key, Pins);
+    if (Memoizable) {
+        auto It = SubtreeMemo.find({CurrGraphNode, Key});
+        if (It != SubtreeMemo.end()) {
+            NumSubtreeShared++;
+            if (PrevTreeNode) PrevTreeNode->addChild(It->second.Node);
+            return It->second.Node;
+        }
+    }
+
+    auto *CurrTreeNode = new SymbolicExecutionTreeNode;
+    if (PrevTreeNode) PrevTreeNode->addChild(CurrTreeNode);
+    Budget->NumNodes++;
+    auto SimplifiedExpr = enter(CurrGraphNode, PhiSelectors);
 
     // set the assertion of the tree node
     CurrTreeNode->setExpr(SimplifiedExpr);
 
     // check feasibility and continue
-    if (!SimplifiedExpr.is_false()) {
+    if (!SimplifiedExpr.is_false() && checkFeasibility(SimplifiedExpr)) {
         if (CurrGraphNode->getNumChildren() == 0) {
             auto *FakeExit = new SymbolicExecutionTreeNode;
             CurrTreeNode->addChild(FakeExit);
         } else {
-            std::vector<std::pair<SliceGraphNode *, std::vector<PhiPointer>>> ChildStateVec;
+            // a child is cut off if any of its combinations is not visited, and the exit added below makes the
+            // explored alternatives of this node unnecessary, so the path condition is weakened but never narrowed
+            bool CutOff = false;
             for (auto ChIt = CurrGraphNode->child_begin(), ChE = CurrGraphNode->child_end(); ChIt != ChE; ++ChIt) {
                 auto *Ch = *ChIt;
+                if (CutOff || exhausted()) {
+                    CutOff = true;
+                    Budget->cutOff(Ch);
+                    continue;
+                }
+
                 std::map<unsigned, std::vector<unsigned>> PhiSelectionMap; // phi_id -> possible value index
                 evaluatePhi(Ch, PhiSelectionMap);
 
-                PushPopVector<PhiPointer> Combination;
-                auto It = PhiSelectionMap.begin();
-                select(It, PhiSelectionMap.end(), Combination, Ch, ChildStateVec);
+                // the combinations are visited as they are enumerated, so at most one of them is alive
+                PhiCombinations Combinations(*this, PhiSelectionMap);
+                std::vector<PhiPointer> Combination;
+                while (Combinations.next(Combination)) {
+                    if (exhausted()) {
+                        CutOff = true;
+                        Budget->cutOff(Ch);
+                        break;
+                    }
+                    visit(CurrTreeNode, Ch, Combination);
+                }
             }
-
-            for (auto &ChState: ChildStateVec) {
-                doSymbolicExecutionDFS(CurrTreeNode, ChState.first, ChState.second);
+            if (CutOff) {
+                auto *FakeExit = new SymbolicExecutionTreeNode;
+                CurrTreeNode->addChild(FakeExit);
             }
         }
     } else {
         CurrTreeNode->setExpr(Z3::bool_val(false));
     }
 
-    PathCondStack.pop();
-    NamedElementStack.pop();
-    PhiSelectorStack.pop();
-    BNFExecutionPath.pop();
+    leave();
+    if (Memoizable)
+        SubtreeMemo.emplace(std::make_pair(CurrGraphNode, std::move(Key)), MemoizedSubtree{CurrTreeNode, Pins});
+    return CurrTreeNode;
+}
+
+const SymbolicExecution::SubtreeFootprint &SymbolicExecution::footprint(SliceGraphNode *Node) {
+    auto It = FootprintMap.find(Node);
+    if (It != FootprintMap.end()) return It->second;
+
+    SubtreeFootprint FP;
+    auto Cond = condition(Node);
+    Z3::atoms(Cond, FP.Atoms);
+    if (FP.Atoms.empty() && !Cond.is_true() && !Cond.is_false()) FP.Ground = true;
+
+    // evaluatePhi reads the selections of the phis and whether their conditions are named
+    auto Phis = Z3::find_all(Cond, true, Z3::is_phi);
+    for (auto Phi: Phis) {
+        auto PhiID = Z3::phi_id(Phi);
+        FP.PhiIDs.push_back(PhiID);
+        for (auto PhiCond: Z3::phi_cond(PhiID)) FP.NamedIDs.push_back(Z3::id(PhiCond));
+    }
+    if (!Phis.empty()) {
+        // an atom over a phi is rebuilt when eliminating the phi, which is not an atom of the original condition
+        FP.Opaque = Z3::find(Cond, [](const z3::expr &E) {
+            if (!E.is_app() || E.num_args() == 0 || Z3::is_phi(E)) return false;
+            auto Kind = E.decl().decl_kind();
+            return (Kind == Z3_OP_SELECT || Kind == Z3_OP_UNINTERPRETED) && Z3::find(E, Z3::is_phi);
+        });
+    }
+
+    // doSymbolicExecutionEliminateUselessNaming reads whether the indices of a naming are named
+    if (Z3::find(Cond, Z3::is_naming)) {
+        auto Selects = Z3::find_all(Cond, true, [](const z3::expr &E) {
+            return E.decl().decl_kind() == Z3_OP_SELECT;
+        });
+        for (auto Select: Selects) FP.NamedIDs.push_back(Z3::id(Select.arg(1)));
+    }
+
+    for (auto ChIt = Node->child_begin(), ChE = Node->child_end(); ChIt != ChE && !FP.Opaque; ++ChIt) {
+        auto &ChFP = footprint(*ChIt);
+        FP.PhiIDs.insert(FP.PhiIDs.end(), ChFP.PhiIDs.begin(), ChFP.PhiIDs.end());
+        FP.NamedIDs.insert(FP.NamedIDs.end(), ChFP.NamedIDs.begin(), ChFP.NamedIDs.end());
+        FP.Atoms.insert(FP.Atoms.end(), ChFP.Atoms.begin(), ChFP.Atoms.end());
+        FP.Ground |= ChFP.Ground;
+        FP.Opaque |= ChFP.Opaque;
+    }
+    sortAndUnique(FP.PhiIDs);
+    sortAndUnique(FP.NamedIDs);
+    sortAndUnique(FP.Atoms);
+    return FootprintMap.emplace(Node, std::move(FP)).first->second;
+}
+
+bool SymbolicExecution::subtreeKey(SliceGraphNode *Node, const std::vector<PhiPointer> &PhiSelectors,
+                                   std::vector<unsigned> &Key, z3::expr_vector &Pins) {
+    auto &FP = footprint(Node);
+    if (FP.Opaque) return false;
+
+    // the selected value index plus one, or zero if the phi is not selected yet
+    for (auto PhiID: FP.PhiIDs) {
+        unsigned Selected = 0;
+        auto It = PhiSelectorStack.find({PhiID, 0});
+        if (It != PhiSelectorStack.end()) {
+            Selected = It->Selected + 1;
+        } else {
+            for (auto &Selector: PhiSelectors) {
+                if (Selector.PhiID != PhiID) continue;
+                Selected = Selector.Selected + 1;
+                break;
+            }
+        }
+        Key.push_back(Selected);
+    }
+
+    for (auto NamedID: FP.NamedIDs) Key.push_back(NamedElementStack.contains(NamedID));
+
+    // a path condition simplifies the subtree only if they share an atom, but whether there is a path condition
+    // at all matters, because a condition is then simplified on its own, e.g., a disjunction of false
+    bool HasPathCond = false;
+    auto AtomIt = PathCondAtomStack.begin();
+    for (auto CondIt = PathCondStack.begin(); CondIt != PathCondStack.end(); ++CondIt, ++AtomIt) {
+        auto &PathCond = *CondIt;
+        if (Z3::is_naming_eq(PathCond)) continue;
+        HasPathCond = true;
+        if (PathCond.is_true()) continue;
+        if (!FP.Ground && !AtomIt->empty() && !intersects(FP.Atoms, *AtomIt)) continue;
+        Key.push_back(Z3::id(PathCond));
+        Pins.push_back(PathCond);
+    }
+    Key.push_back(HasPathCond);
+    return true;
+}
+
+bool SymbolicExecution::checkFeasibility(const z3::expr &Expr) {
+    if (!SESolver) return true;
+
+    // the prefix of the path has been asserted in the outer scopes, only add the new condition
+    // a naming is not a real constraint, and asserting two of them may unify unrelated bytes
+    if (Expr.is_true() || Z3::is_naming_eq(Expr)) return true;
+    Z3Solver::add(Expr);
+    return Z3Solver::check();
 }
 
 z3::expr SymbolicExecution::doSymbolicExecutionSimplify(const z3::expr &Assert) {
@@ -223,9 +714,20 @@ z3::expr SymbolicExecution::doSymbolicExecutionEliminateConflict(const z3::expr
 }
 
 z3::expr SymbolicExecution::doSymbolicExecutionEliminatePhi(const z3::expr &Expr) {
-    if (Expr.is_const()) {
-        return Expr;
-    } else if (Z3::is_phi(Expr)) {
+    if (Expr.is_const()) return Expr;
+
+    // selectors are only added in deeper scopes, so a memoized result stays valid until its scope is popped
+    auto ExprID = Z3::id(Expr);
+    auto MemoIt = EliminatePhiMemo.find(ExprID);
+    if (MemoIt != EliminatePhiMemo.end()) return MemoIt->second;
+
+    auto Ret = doSymbolicExecutionEliminatePhiNoMemo(Expr);
+    EliminatePhiMemo.add(ExprID, Ret);
+    return Ret;
+}
+
+z3::expr SymbolicExecution::doSymbolicExecutionEliminatePhiNoMemo(const z3::expr &Expr) {
+    if (Z3::is_phi(Expr)) {
         auto It = PhiSelectorStack.find({Z3::phi_id(Expr), 0});
         assert (It != PhiSelectorStack.end());
         LLVM_DEBUG(dbgs() << "[SE] \tphi." << It->PhiID << " selects " << It->Selected << "\n");
@@ -26,7 +26,7 @@ using namespace llvm;
 
 void SymbolicExecutionTreeNode::addChild(SymbolicExecutionTreeNode *E) {
     Children.insert(E);
-    E->Parent = this;
+    E->Parents.insert(this);
 }
 
 SymbolicExecutionTree::~SymbolicExecutionTree() {
@@ -62,7 +62,7 @@ void SymbolicExecutionTree::dot(std::string &File, const char *NameSuffix) const
     auto DotNode = [](SymbolicExecutionTreeNode *Node, raw_ostream &OS) {
         const char *EntryExitStyle = R"(shape=record,color="#3d50c3ff", style=filled, fillcolor="#abc8fd70")";
         const char *OtherStyle = R"(shape=record,color="#b70d28ff", style=filled, fillcolor="#b70d2870")";
-        bool RootOrLeaves = Node->Parent == nullptr || Node->Children.empty();
+        bool RootOrLeaves = Node->Parents.empty() || Node->Children.empty();
         OS << "\ta" << Node << "[" << (RootOrLeaves ? EntryExitStyle : OtherStyle) << ", label=\"{";
         auto Str = Z3::to_string(Node->Expr, true);
         if (Str.length() > 100)
@@ -107,38 +107,27 @@ void SymbolicExecutionTree::simplify() {
 
 void SymbolicExecutionTree::compressInfeasiblePaths() {
     std::vector<SymbolicExecutionTreeNode *> FalseNodeVec;
-    std::stack<SymbolicExecutionTreeNode *> DFSStack;
-    DFSStack.push(Root);
-    while (!DFSStack.empty()) {
-        auto Top = DFSStack.top();
-        DFSStack.pop();
-
-        if (Top->getExpr().is_false()) {
-            assert(Top != Root);
-            assert(Top->Children.empty());
-            FalseNodeVec.push_back(Top);
+    dfs([this, &FalseNodeVec](SymbolicExecutionTreeNode *N) {
+        if (N->getExpr().is_false()) {
+            assert(N != Root);
+            assert(N->Children.empty());
+            FalseNodeVec.push_back(N);
         }
-
-        for (auto *Ch: Top->Children) {
-            //if (!Ch->Children.empty())
-                DFSStack.push(Ch);
-        }
-    }
+    });
 
     while (!FalseNodeVec.empty()) {
         auto FalseNode = FalseNodeVec.back();
         FalseNodeVec.pop_back();
         assert(FalseNode != Root);
 
-        // remove FalseNode
-        auto *Parent = FalseNode->Parent;
-        Parent->Children.erase(FalseNode);
-        FalseNode->Parent = nullptr;
-        delete FalseNode;
-
-        if (Parent->Children.empty()) {
-            FalseNodeVec.push_back(Parent);
+        // remove FalseNode, a parent becomes infeasible when its last child is removed, so it is pushed only once
+        for (auto *Parent: FalseNode->Parents) {
+            Parent->Children.erase(FalseNode);
+            if (Parent->Children.empty()) {
+                FalseNodeVec.push_back(Parent);
+            }
         }
+        delete FalseNode;
     }
 }
 
@@ -147,57 +136,81 @@ void SymbolicExecutionTree::compressOffsprings() {
         return E.is_false() || E.is_true() || Z3::is_free(E);
     };
 
-    std::stack<SymbolicExecutionTreeNode *> DFSStack;
-    DFSStack.push(Root);
-    while (!DFSStack.empty()) {
-        auto Top = DFSStack.top();
-        DFSStack.pop();
-        for (auto *Ch: Top->Children) {
-            if (!Ch->Children.empty())
-                DFSStack.push(Ch);
+    // visit a node after all its parents, so that it is compared with its parents after they are compressed
+    std::vector<SymbolicExecutionTreeNode *> TopoOrder;
+    std::unordered_map<SymbolicExecutionTreeNode *, unsigned> InDegreeMap;
+    TopoOrder.push_back(Root);
+    for (unsigned K = 0; K < TopoOrder.size(); ++K) {
+        for (auto *Ch: TopoOrder[K]->Children) {
+            auto It = InDegreeMap.insert({Ch, Ch->Parents.size()}).first;
+            if (--It->second == 0) TopoOrder.push_back(Ch);
         }
+    }
 
-        if (Top == Root) continue;
+    for (auto *Top: TopoOrder) {
+        if (Top == Root || Top->Children.empty()) continue;
 
-        auto *TopParent = Top->Parent;
-        if (NotRelated(Top->getExpr()) || Z3::same(Top->getExpr(), TopParent->getExpr())) {
+        bool Redundant = NotRelated(Top->getExpr());
+        if (!Redundant) {
+            Redundant = true;
+            for (auto *TopParent: Top->Parents) {
+                if (!Z3::same(Top->getExpr(), TopParent->getExpr())) {
+                    Redundant = false;
+                    break;
+                }
+            }
+        }
+        if (!Redundant) continue;
+
+        for (auto *TopParent: Top->Parents) {
             TopParent->Children.erase(Top);
             for (auto *Ch: Top->Children) {
                 TopParent->Children.insert(Ch);
-                Ch->Parent = TopParent;
+                Ch->Parents.insert(TopParent);
             }
-            delete Top;
         }
+        for (auto *Ch: Top->Children) Ch->Parents.erase(Top);
+        delete Top;
     }
 }
 
 void SymbolicExecutionTree::compressSiblings() {
+    std::set<SymbolicExecutionTreeNode *> Visited;
     std::stack<SymbolicExecutionTreeNode *> DFSStack;
     DFSStack.push(Root);
     while (!DFSStack.empty()) {
         auto Top = DFSStack.top();
         DFSStack.pop();
-
-        auto IIt = Top->Children.begin();
-        while (IIt != Top->Children.end()) {
-            auto *I = *IIt;
-
-            auto JIt = IIt;
-            ++JIt;
-            while (JIt != Top->Children.end()) {
-                auto *J = *JIt;
-                if (Z3::same(I->getExpr(), J->getExpr())) {
-                    for (auto *JCh: J->Children) {
-                        I->Children.insert(JCh);
-                        JCh->Parent = I;
-                    }
+        if (!Visited.insert(Top).second) continue;
+
+        // group the children by their exprs, and merge each group into its first node
+        std::vector<SymbolicExecutionTreeNode *> ChildVec(Top->Children.begin(), Top->Children.end());
+        std::map<unsigned, std::vector<SymbolicExecutionTreeNode *>> GroupMap;
+        for (auto *Ch: ChildVec) GroupMap[Z3::id(Ch->getExpr())].push_back(Ch);
+        for (auto &It: GroupMap) {
+            auto &Group = It.second;
+            if (Group.size() == 1) continue;
+
+            auto *I = Group[0];
+            if (I->Parents.size() > 1) {
+                // other parents share the node, merging into it changes their paths, so merge into a copy
+                auto *Copy = new SymbolicExecutionTreeNode(I->getExpr());
+                for (auto *ICh: I->Children) Copy->addChild(ICh);
+                Top->Children.erase(I);
+                I->Parents.erase(Top);
+                Top->addChild(Copy);
+                I = Copy;
+            }
+            for (unsigned K = 1; K < Group.size(); ++K) {
+                auto *J = Group[K];
+                for (auto *JCh: J->Children) I->addChild(JCh);
+                Top->Children.erase(J);
+                J->Parents.erase(Top);
+                if (J->Parents.empty()) {
+                    for (auto *JCh: J->Children) JCh->Parents.erase(J);
                     delete J;
-                    JIt = Top->Children.erase(JIt);
-                } else {
-                    JIt++;
                 }
             }
-            IIt++;
         }
 
         for (auto *Ch: Top->Children) {
@@ -207,15 +220,20 @@ void SymbolicExecutionTree::compressSiblings() {
 }
 
 z3::expr SymbolicExecutionTree::pc() const {
-    return pc(Root);
+    std::unordered_map<SymbolicExecutionTreeNode *, z3::expr> Memo;
+    return pc(Root, Memo);
 }
 
-z3::expr SymbolicExecutionTree::pc(SymbolicExecutionTreeNode *Node) const {
+z3::expr SymbolicExecutionTree::pc(SymbolicExecutionTreeNode *Node,
+                                   std::unordered_map<SymbolicExecutionTreeNode *, z3::expr> &Memo) const {
+    auto It = Memo.find(Node);
+    if (It != Memo.end()) return It->second;
+
     z3::expr_vector Vec = Z3::vec();
     for (auto *Ch: Node->Children) {
-        Vec.push_back(pc(Ch));
+        Vec.push_back(pc(Ch, Memo));
     }
-    if (Vec.empty())
-        return Node->getExpr();
-    return Node->getExpr() && z3::mk_or(Vec);
+    auto Ret = Vec.empty() ? Node->getExpr() : Node->getExpr() && z3::mk_or(Vec);
+    Memo.emplace(Node, Ret);
+    return Ret;
 }
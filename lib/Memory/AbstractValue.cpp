@@ -38,6 +38,12 @@ StringRef AbstractValue::getKindName() const {
 
 void ScalarValue::assign(AbstractValue *AV) {
     assert(bytewidth() == AV->bytewidth());
+    uint64_t Val;
+    auto *SV = dyn_cast<ScalarValue>(AV);
+    if (SV && SV->concrete(Val)) {
+        set(Val);
+        return;
+    }
     set(AV->value());
 }
 
@@ -330,19 +336,41 @@ std::string AddressValue::str() {
 }
 
 namespace abs_value {
+    // the native fast paths below follow the constant folding in Z3Arithmetic.cpp and Z3Relational.cpp,
+    // they give up whenever the folding would be undefined in c++, e.g., dividing by zero
+
+    static inline bool concrete(AbstractValue *A, uint64_t &C) {
+        auto *SV = dyn_cast<ScalarValue>(A);
+        return SV && SV->concrete(C);
+    }
+
+    static inline bool concrete(AbstractValue *A1, AbstractValue *A2, uint64_t &C1, uint64_t &C2) {
+        return concrete(A1, C1) && concrete(A2, C2);
+    }
+
+    static inline int64_t to_signed(uint64_t V, unsigned Bytes) {
+        return ((int64_t) (V << (64 - Bytes * 8))) >> (64 - Bytes * 8);
+    }
+
     // start of cast operations
 
     void trunc(AbstractValue *Dst, AbstractValue *Src) {
+        uint64_t C;
+        if (concrete(Src, C)) return Dst->set(C);
         if (Src->poison()) return;
         Dst->set(Z3::trunc(Src->value(), Dst->bytewidth() * 8));
     }
 
     void sext(AbstractValue *Dst, AbstractValue *Src) {
+        uint64_t C;
+        if (Dst->bytewidth() <= 8 && concrete(Src, C)) return Dst->set((uint64_t) to_signed(C, Src->bytewidth()));
         if (Src->poison()) return;
         Dst->set(Z3::sext(Src->value(), Dst->bytewidth() * 8));
     }
 
     void zext(AbstractValue *Dst, AbstractValue *Src) {
+        uint64_t C;
+        if (Dst->bytewidth() <= 8 && concrete(Src, C)) return Dst->set(C);
         if (Src->poison()) return;
         Dst->set(Z3::zext(Src->value(), Dst->bytewidth() * 8));
     }
@@ -351,11 +379,15 @@ namespace abs_value {
     // start of arithmetic operations
 
     void neg(AbstractValue *Dst, AbstractValue *Val) {
+        uint64_t C;
+        if (concrete(Val, C)) return Dst->set(0 - C);
         ScalarValue Zero(Val->bytewidth(), Z3::bv_val(0, Val->bytewidth() * 8));
         sub(Dst, &Zero, Val);
     }
 
     void add(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set(C1 + C2);
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -363,6 +395,8 @@ namespace abs_value {
     }
 
     void sub(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set(C1 - C2);
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -370,6 +404,8 @@ namespace abs_value {
     }
 
     void mul(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set(C1 * C2);
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -377,6 +413,8 @@ namespace abs_value {
     }
 
     void udiv(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2) && C2) return Dst->set(C1 / C2);
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -384,6 +422,12 @@ namespace abs_value {
     }
 
     void sdiv(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) {
+            auto S1 = to_signed(C1, A1->bytewidth());
+            auto S2 = to_signed(C2, A2->bytewidth());
+            if (S2 && !(S1 == INT64_MIN && S2 == -1)) return Dst->set((uint64_t) (S1 / S2));
+        }
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -391,6 +435,8 @@ namespace abs_value {
     }
 
     void urem(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2) && C2) return Dst->set(C1 % C2);
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -398,6 +444,12 @@ namespace abs_value {
     }
 
     void srem(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) {
+            auto S1 = to_signed(C1, A1->bytewidth());
+            auto S2 = to_signed(C2, A2->bytewidth());
+            if (S2 && !(S1 == INT64_MIN && S2 == -1)) return Dst->set((uint64_t) (S1 % S2));
+        }
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -405,6 +457,8 @@ namespace abs_value {
     }
 
     void bvand(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set(C1 & C2);
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -412,6 +466,8 @@ namespace abs_value {
     }
 
     void bvor(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set(C1 | C2);
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -419,6 +475,8 @@ namespace abs_value {
     }
 
     void bvxor(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set(C1 ^ C2);
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -426,6 +484,8 @@ namespace abs_value {
     }
 
     void shl(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2) && C2 < 64) return Dst->set(C1 << C2);
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -433,6 +493,11 @@ namespace abs_value {
     }
 
     void ashr(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) {
+            auto S2 = to_signed(C2, A2->bytewidth());
+            if (S2 >= 0 && S2 < 64) return Dst->set((uint64_t) (to_signed(C1, A1->bytewidth()) >> S2));
+        }
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -440,6 +505,8 @@ namespace abs_value {
     }
 
     void lshr(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2) && C2 < 64) return Dst->set(C1 >> C2);
         if (A1->poison() || A2->poison()) return;
         auto &O1 = A1->value();
         auto &O2 = A2->value();
@@ -458,17 +525,21 @@ namespace abs_value {
     }
 
     void sgt(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set((uint64_t) (to_signed(C1, A1->bytewidth()) > to_signed(C2, A2->bytewidth())));
         if (A1->poison() || A2->poison()) return;
-        z3::expr &O1 = A1->value();
-        z3::expr &O2 = A2->value();
+        const z3::expr &O1 = A1->value();
+        const z3::expr &O2 = A2->value();
         auto Ret = Z3::sgt(O1, O2);
         Dst->set(Z3::bool_to_bv(Ret, Dst->bytewidth() * 8));
     }
 
     void sge(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set((uint64_t) (to_signed(C1, A1->bytewidth()) >= to_signed(C2, A2->bytewidth())));
         if (A1->poison() || A2->poison()) return;
-        z3::expr &O1 = A1->value();
-        z3::expr &O2 = A2->value();
+        const z3::expr &O1 = A1->value();
+        const z3::expr &O2 = A2->value();
         auto Ret = Z3::sge(O1, O2);
         Dst->set(Z3::bool_to_bv(Ret, Dst->bytewidth() * 8));
     }
@@ -482,33 +553,41 @@ namespace abs_value {
     }
 
     void ugt(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set((uint64_t) (C1 > C2));
         if (A1->poison() || A2->poison()) return;
-        z3::expr &O1 = A1->value();
-        z3::expr &O2 = A2->value();
+        const z3::expr &O1 = A1->value();
+        const z3::expr &O2 = A2->value();
         auto Ret = Z3::ugt(O1, O2);
         Dst->set(Z3::bool_to_bv(Ret, Dst->bytewidth() * 8));
     }
 
     void uge(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set((uint64_t) (C1 >= C2));
         if (A1->poison() || A2->poison()) return;
-        z3::expr &O1 = A1->value();
-        z3::expr &O2 = A2->value();
+        const z3::expr &O1 = A1->value();
+        const z3::expr &O2 = A2->value();
         auto Ret = Z3::uge(O1, O2);
         Dst->set(Z3::bool_to_bv(Ret, Dst->bytewidth() * 8));
     }
 
     void eq(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set((uint64_t) (C1 == C2));
         if (A1->poison() || A2->poison()) return;
-        z3::expr &O1 = A1->value();
-        z3::expr &O2 = A2->value();
+        const z3::expr &O1 = A1->value();
+        const z3::expr &O2 = A2->value();
         auto Ret = Z3::eq(O1, O2);
         Dst->set(Z3::bool_to_bv(Ret, Dst->bytewidth() * 8));
     }
 
     void ne(AbstractValue *Dst, AbstractValue *A1, AbstractValue *A2) {
+        uint64_t C1, C2;
+        if (concrete(A1, A2, C1, C2)) return Dst->set((uint64_t) (C1 != C2));
         if (A1->poison() || A2->poison()) return;
-        z3::expr &O1 = A1->value();
-        z3::expr &O2 = A2->value();
+        const z3::expr &O1 = A1->value();
+        const z3::expr &O2 = A2->value();
         auto Ret = Z3::ne(O1, O2);
         Dst->set(Z3::bool_to_bv(Ret, Dst->bytewidth() * 8));
     }
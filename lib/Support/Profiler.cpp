@@ -0,0 +1,228 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+#include <z3.h>
+#include "Support/Debug.h"
+#include "Support/Profiler.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> ProfileFile(
+        "popeye-profile",
+        cl::desc("write a hierarchical profile in the chrome trace_event format to the file"),
+        cl::init(""));
+
+static cl::opt<unsigned> MaxProfileEvents(
+        "popeye-profile-max-events",
+        cl::desc("the max number of trace events kept in the profile, scopes are always aggregated"),
+        cl::init(1u << 20));
+
+bool Profiler::Enabled = false;
+
+namespace {
+struct ProfileCost {
+    uint64_t Count = 0;
+    int64_t Wall = 0; // us
+    int64_t Cpu = 0; // us
+    int64_t Rss = 0; // kb of the peak rss
+    int64_t Z3Mem = 0; // kb
+};
+
+/// a node of the tree aggregating scopes by their paths from the root
+struct ProfileNode {
+    const char *Category = "";
+    ProfileCost Cost;
+    std::map<std::string, std::unique_ptr<ProfileNode>> Children;
+};
+
+struct ProfileEvent {
+    const char *Category;
+    std::string Name;
+    unsigned Tid;
+    int64_t Begin; // us since the profiler is initialized
+    ProfileCost Cost;
+};
+
+struct ProfileFrame {
+    ProfileNode *Node;
+    const char *Category;
+    std::string Name;
+    int64_t Wall;
+    int64_t Cpu;
+    int64_t Rss;
+    int64_t Z3Mem;
+};
+}
+
+static std::chrono::steady_clock::time_point Start;
+static std::mutex Lock;
+static ProfileNode Root;
+static std::vector<ProfileEvent> Events;
+static uint64_t NumDropped = 0;
+static std::map<std::string, int64_t> Counters;
+static std::atomic<unsigned> NumThreads{0};
+
+static thread_local std::vector<ProfileFrame> Stack;
+static thread_local unsigned Tid = NumThreads++;
+
+static int64_t wall() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start).count();
+}
+
+static int64_t cpu() {
+    timespec TS{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &TS);
+    return (int64_t) TS.tv_sec * 1000000 + TS.tv_nsec / 1000;
+}
+
+static int64_t rss() {
+    rusage Usage{};
+    getrusage(RUSAGE_SELF, &Usage);
+    return Usage.ru_maxrss;
+}
+
+static int64_t z3mem() {
+    return (int64_t) (Z3_get_estimated_alloc_size() / 1024);
+}
+
+void Profiler::initialize() {
+    Enabled = !ProfileFile.getValue().empty();
+    Start = std::chrono::steady_clock::now();
+}
+
+void Profiler::begin(const char *Category, StringRef Name) {
+    ProfileNode *Node;
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        auto *Parent = Stack.empty() ? &Root : Stack.back().Node;
+        auto &Child = Parent->Children[Name.str()];
+        if (!Child) {
+            Child.reset(new ProfileNode);
+            Child->Category = Category;
+        }
+        Node = Child.get();
+    }
+    Stack.push_back({Node, Category, Name.str(), wall(), cpu(), rss(), z3mem()});
+}
+
+void Profiler::end() {
+    assert(!Stack.empty());
+    auto &Frame = Stack.back();
+    ProfileCost Cost;
+    Cost.Count = 1;
+    Cost.Wall = wall() - Frame.Wall;
+    Cost.Cpu = cpu() - Frame.Cpu;
+    Cost.Rss = rss() - Frame.Rss;
+    Cost.Z3Mem = z3mem() - Frame.Z3Mem;
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        auto &Total = Frame.Node->Cost;
+        Total.Count++;
+        Total.Wall += Cost.Wall;
+        Total.Cpu += Cost.Cpu;
+        Total.Rss += Cost.Rss;
+        Total.Z3Mem += Cost.Z3Mem;
+        if (Events.size() < MaxProfileEvents) {
+            Events.push_back({Frame.Category, std::move(Frame.Name), Tid, Frame.Wall, Cost});
+        } else {
+            NumDropped++;
+        }
+    }
+    Stack.pop_back();
+}
+
+void Profiler::counter(StringRef Name, int64_t Value) {
+    if (!Enabled) return;
+    std::lock_guard<std::mutex> Guard(Lock);
+    Counters[Name.str()] = Value;
+}
+
+static void write(json::OStream &J, const ProfileCost &Cost) {
+    J.attribute("wall_us", Cost.Wall);
+    J.attribute("cpu_us", Cost.Cpu);
+    J.attribute("peak_rss_delta_kb", Cost.Rss);
+    J.attribute("z3_mem_delta_kb", Cost.Z3Mem);
+}
+
+static void write(json::OStream &J, const std::string &Name, const ProfileNode &Node) {
+    J.object([&] {
+        J.attribute("name", Name);
+        J.attribute("cat", Node.Category);
+        J.attribute("count", (int64_t) Node.Cost.Count);
+        write(J, Node.Cost);
+        J.attributeArray("children", [&] {
+            for (auto &It: Node.Children) write(J, It.first, *It.second);
+        });
+    });
+}
+
+void Profiler::finalize() {
+    if (!Enabled) return;
+    while (!Stack.empty()) end(); // close the scopes outliving the profiler
+    Enabled = false;
+
+    std::error_code EC;
+    raw_fd_ostream OS(ProfileFile.getValue(), EC);
+    if (EC) {
+        errs() << "Cannot write the profile to " << ProfileFile.getValue() << ": " << EC.message() << "\n";
+        return;
+    }
+
+    std::lock_guard<std::mutex> Guard(Lock);
+    json::OStream J(OS, 1);
+    J.object([&] {
+        J.attributeArray("traceEvents", [&] {
+            for (auto &E: Events) {
+                J.object([&] {
+                    J.attribute("name", E.Name);
+                    J.attribute("cat", E.Category);
+                    J.attribute("ph", "X");
+                    J.attribute("ts", E.Begin);
+                    J.attribute("dur", E.Cost.Wall);
+                    J.attribute("pid", 1);
+                    J.attribute("tid", (int64_t) E.Tid);
+                    J.attributeObject("args", [&] { write(J, E.Cost); });
+                });
+            }
+        });
+        J.attribute("displayTimeUnit", "ms");
+        J.attribute("droppedEvents", (int64_t) NumDropped);
+        J.attribute("peak_rss_kb", rss());
+        J.attributeObject("counters", [&] {
+            for (auto &It: Counters) J.attribute(It.first, It.second);
+        });
+        J.attributeArray("profile", [&] {
+            for (auto &It: Root.Children) write(J, It.first, *It.second);
+        });
+    });
+    OS << "\n";
+    POPEYE_INFO("Profile: " << Events.size() << " scopes written to " << ProfileFile.getValue());
+}
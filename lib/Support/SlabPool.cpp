@@ -0,0 +1,148 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "Support/SlabPool.h"
+
+namespace {
+const size_t SlabSize = 64 * 1024;
+const size_t Granularity = 16;
+const size_t MaxObjectSize = 512;
+const size_t NumSizeClasses = MaxObjectSize / Granularity;
+
+struct FreeObject {
+    FreeObject *Next;
+};
+
+struct SizeClass;
+
+/// the header at the beginning of a slab, followed by the objects
+struct Slab {
+    SizeClass *Owner;
+    FreeObject *FreeList = nullptr;
+    /// the objects that have never been allocated start from here
+    char *Bump;
+    unsigned NumLive = 0;
+    /// whether the slab is in SizeClass::Partial
+    bool Partial = true;
+
+    Slab(SizeClass *SC, size_t HeaderSize) : Owner(SC), Bump((char *) this + HeaderSize) {}
+
+    char *end() { return (char *) this + SlabSize; }
+};
+
+struct SizeClass {
+    size_t ObjectSize = 0;
+    std::vector<Slab *> Slabs;
+    /// the slabs that may have free objects
+    std::vector<Slab *> Partial;
+    size_t NumEmpty = 0;
+};
+
+const size_t HeaderSize = (sizeof(Slab) + Granularity - 1) / Granularity * Granularity;
+}
+
+/// never destroyed, since values in static containers are released after the pool would be destroyed
+static SizeClass *sizeClasses() {
+    static auto *SizeClasses = [] {
+        auto *Ret = new SizeClass[NumSizeClasses];
+        for (size_t K = 0; K < NumSizeClasses; ++K) Ret[K].ObjectSize = (K + 1) * Granularity;
+        return Ret;
+    }();
+    return SizeClasses;
+}
+
+static void *take(Slab *S) {
+    void *Ret = nullptr;
+    if (S->FreeList) {
+        Ret = S->FreeList;
+        S->FreeList = S->FreeList->Next;
+    } else if (S->Bump + S->Owner->ObjectSize <= S->end()) {
+        Ret = S->Bump;
+        S->Bump += S->Owner->ObjectSize;
+    } else {
+        return nullptr;
+    }
+    if (S->NumLive++ == 0) S->Owner->NumEmpty--;
+    return Ret;
+}
+
+void *SlabPool::allocate(size_t Size) {
+    if (Size == 0) Size = 1;
+    if (Size > MaxObjectSize) return ::operator new(Size);
+
+    auto &SC = sizeClasses()[(Size - 1) / Granularity];
+    while (!SC.Partial.empty()) {
+        auto *S = SC.Partial.back();
+        if (auto *Ret = take(S)) return Ret;
+        S->Partial = false;
+        SC.Partial.pop_back();
+    }
+
+    // slabs are aligned to their size, so that the slab of an object is found by masking its address
+    void *Buffer = nullptr;
+    if (posix_memalign(&Buffer, SlabSize, SlabSize)) throw std::bad_alloc();
+    auto *S = new(Buffer) Slab(&SC, HeaderSize);
+    SC.Slabs.push_back(S);
+    SC.Partial.push_back(S);
+    SC.NumEmpty++;
+    return take(S);
+}
+
+void SlabPool::deallocate(void *Ptr, size_t Size) {
+    if (!Ptr) return;
+    if (Size == 0) Size = 1;
+    if (Size > MaxObjectSize) return ::operator delete(Ptr);
+
+    auto *S = (Slab *) ((uintptr_t) Ptr & ~(uintptr_t) (SlabSize - 1));
+    auto *Obj = (FreeObject *) Ptr;
+    Obj->Next = S->FreeList;
+    S->FreeList = Obj;
+    if (--S->NumLive == 0) S->Owner->NumEmpty++;
+    if (!S->Partial) {
+        S->Partial = true;
+        S->Owner->Partial.push_back(S);
+    }
+}
+
+void SlabPool::release() {
+    auto *SizeClasses = sizeClasses();
+    for (size_t K = 0; K < NumSizeClasses; ++K) {
+        auto &SC = SizeClasses[K];
+        // keep a few empty slabs, otherwise a function called in a loop keeps mapping and unmapping them
+        if (SC.NumEmpty <= 2 || SC.NumEmpty * 4 < SC.Slabs.size()) continue;
+
+        bool KeepOne = true;
+        std::vector<Slab *> Slabs;
+        std::vector<Slab *> Partial;
+        for (auto *S: SC.Slabs) {
+            if (S->NumLive == 0 && !KeepOne) {
+                free(S);
+                continue;
+            }
+            if (S->NumLive == 0) KeepOne = false;
+            Slabs.push_back(S);
+            if (S->Partial) Partial.push_back(S);
+        }
+        SC.Slabs.swap(Slabs);
+        SC.Partial.swap(Partial);
+        SC.NumEmpty = 1;
+    }
+}
@@ -0,0 +1,119 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Support/WorkStealingPool.h"
+
+static thread_local WorkStealingPool *CurrentPool = nullptr;
+static thread_local int CurrentWorker = -1;
+
+WorkStealingPool::WorkStealingPool(unsigned NumThreads) {
+    if (NumThreads == 0) NumThreads = 1;
+    for (unsigned K = 0; K < NumThreads; ++K) Queues.emplace_back(new WorkQueue);
+    for (unsigned K = 0; K < NumThreads; ++K) Threads.emplace_back(&WorkStealingPool::work, this, K);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> L(Lock);
+        Stopped = true;
+    }
+    WorkCond.notify_all();
+    for (auto &T: Threads) T.join();
+}
+
+int WorkStealingPool::currentWorker() {
+    return CurrentWorker;
+}
+
+void WorkStealingPool::submit(Task T) {
+    unsigned ID = CurrentPool == this ? (unsigned) CurrentWorker : NextQueue++ % Queues.size();
+    NumPending++;
+    {
+        auto &Q = *Queues[ID];
+        std::lock_guard<std::mutex> L(Q.Lock);
+        Q.Tasks.push_back(std::move(T));
+        NumQueued++;
+    }
+    {
+        // pair with the predicate check of sleeping workers so that the notification is not lost
+        std::lock_guard<std::mutex> L(Lock);
+    }
+    WorkCond.notify_one();
+}
+
+void WorkStealingPool::wait() {
+    {
+        std::unique_lock<std::mutex> L(Lock);
+        DoneCond.wait(L, [this]() { return NumPending.load() == 0; });
+    }
+    if (Error) {
+        auto E = Error;
+        Error = nullptr;
+        std::rethrow_exception(E);
+    }
+}
+
+bool WorkStealingPool::pop(unsigned ID, Task &T) {
+    // own tasks first, from the back, then steal from the front of others
+    for (unsigned K = 0; K < Queues.size(); ++K) {
+        auto &Q = *Queues[(ID + K) % Queues.size()];
+        std::lock_guard<std::mutex> L(Q.Lock);
+        if (Q.Tasks.empty()) continue;
+        if (K == 0) {
+            T = std::move(Q.Tasks.back());
+            Q.Tasks.pop_back();
+        } else {
+            T = std::move(Q.Tasks.front());
+            Q.Tasks.pop_front();
+        }
+        NumQueued--;
+        return true;
+    }
+    return false;
+}
+
+bool WorkStealingPool::tryRun(unsigned ID) {
+    Task T;
+    if (!pop(ID, T)) return false;
+    try {
+        T();
+    } catch (...) {
+        std::lock_guard<std::mutex> L(Lock);
+        if (!Error) Error = std::current_exception();
+    }
+    T = nullptr;
+    if (--NumPending == 0) {
+        std::lock_guard<std::mutex> L(Lock);
+        DoneCond.notify_all();
+    }
+    return true;
+}
+
+void WorkStealingPool::work(unsigned ID) {
+    CurrentPool = this;
+    CurrentWorker = (int) ID;
+    while (true) {
+        if (tryRun(ID)) continue;
+
+        std::unique_lock<std::mutex> L(Lock);
+        NumIdle++;
+        WorkCond.wait(L, [this]() { return Stopped || NumQueued.load() > 0; });
+        NumIdle--;
+        if (Stopped && NumQueued.load() == 0) return;
+    }
+}
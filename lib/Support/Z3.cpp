@@ -16,32 +16,122 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include "Support/Debug.h"
+#include "Support/Profiler.h"
 #include "Support/Z3.h"
+#include "Z3Context.h"
 #include "Z3Macro.h"
+#include "Z3SolverCache.h"
+#include "Z3Symbol.h"
 
-static z3::context *Ctx = nullptr;
-static z3::expr *Len = nullptr;
+static const std::thread::id MainThread = std::this_thread::get_id();
 
-static z3::solver *Solver = nullptr;
-static z3::expr_vector *SolverAssumptions = nullptr;
+/// protects the registry of contexts and serializes translations, because a translation reads the source context
+static std::mutex ContextLock;
+static std::unordered_map<Z3_context, Z3Context *> Contexts;
+
+static thread_local Z3Context *CurrentContext = nullptr;
+
+namespace {
+/// release the context of a thread when the thread exits
+struct ContextReleaser {
+    ~ContextReleaser() {
+        if (CurrentContext && std::this_thread::get_id() != MainThread) {
+            delete CurrentContext;
+            CurrentContext = nullptr;
+        }
+    }
+};
+}
+
+static thread_local ContextReleaser Releaser;
+
+Z3Context::Z3Context() : SymbolDecls(Ctx) {
+    std::lock_guard<std::mutex> L(ContextLock);
+    Contexts[Ctx] = this;
+}
+
+Z3Context::~Z3Context() {
+    std::lock_guard<std::mutex> L(ContextLock);
+    Contexts.erase(Ctx);
+}
+
+Z3Context &Z3Context::get() {
+    if (!CurrentContext) {
+        (void) &Releaser; // odr-use the releaser so that it is constructed in this thread
+        CurrentContext = new Z3Context;
+    }
+    return *CurrentContext;
+}
+
+/// z3 allocates the ids of declarations from 2^31, strip the offset to index the symbol table
+static unsigned decl_index(Z3_context Ctx, Z3_func_decl Decl) {
+    return Z3_get_func_decl_id(Ctx, Decl) & ~(1u << 31);
+}
+
+void Z3Context::record(const z3::func_decl &Decl, Z3Symbol::Kind K, unsigned PhiID) {
+    unsigned DeclID = decl_index(Ctx, Decl);
+    if (DeclID >= SymbolTable.size()) SymbolTable.resize(std::max(DeclID + 1, (unsigned) SymbolTable.size() * 2));
+    auto &Info = SymbolTable[DeclID];
+    if (Info.Kind != Z3Symbol::SK_None) {
+        assert(Info.Kind == K && Info.PhiID == PhiID);
+        return;
+    }
+    Info.Kind = K;
+    Info.PhiID = PhiID;
+    SymbolDecls.push_back(Decl);
+}
+
+const Z3Context::SymbolInfo *Z3Context::symbol(Z3_func_decl Decl) const {
+    unsigned DeclID = decl_index(Ctx, Decl);
+    if (DeclID >= SymbolTable.size() || SymbolTable[DeclID].Kind == Z3Symbol::SK_None) return nullptr;
+    return &SymbolTable[DeclID];
+}
+
+const Z3Context::SymbolInfo *Z3Context::symbol(const z3::expr &E) const {
+    if (!E.is_app()) return nullptr;
+    return symbol(Z3_get_app_decl(Ctx, Z3_to_app(Ctx, E)));
+}
 
 static z3::context &ctx() {
-    if (!Ctx)
-        Ctx = new z3::context;
-    return *Ctx;
+    return Z3Context::get().Ctx;
+}
+
+#ifndef NDEBUG
+/// the tables of the facade are kept per context, thus an expr must be used in the thread owning its context
+static bool owned(const z3::expr &E) {
+    return (Z3_context) E.ctx() == (Z3_context) Z3Context::get().Ctx;
 }
+#endif
 
 static z3::solver &solver() {
-    if (!Solver)
-        Solver = new z3::solver(ctx());
-    return *Solver;
+    auto &C = Z3Context::get();
+    if (!C.Solver)
+        C.Solver.reset(new z3::solver(C.Ctx));
+    return *C.Solver;
+}
+
+static z3::solver &scoped_solver() {
+    auto &C = Z3Context::get();
+    if (!C.ScopedSolver)
+        C.ScopedSolver.reset(new z3::solver(C.Ctx));
+    return *C.ScopedSolver;
 }
 
 static z3::expr_vector &solver_assumptions() {
-    if (!SolverAssumptions)
-        SolverAssumptions = new z3::expr_vector(ctx());
-    return *SolverAssumptions;
+    auto &C = Z3Context::get();
+    if (!C.SolverAssumptions)
+        C.SolverAssumptions.reset(new z3::expr_vector(C.Ctx));
+    return *C.SolverAssumptions;
+}
+
+static unsigned &solver_scopes() {
+    return Z3Context::get().SolverScopes;
 }
 
 void Z3::initialize() {
@@ -49,16 +139,103 @@ void Z3::initialize() {
 }
 
 void Z3::finalize() {
-#define DEINIT(X) do { if (X) { delete X; X = nullptr; } } while(0)
-
     // fixme:
-    // do not delete them now, because some structures, e.g., AbstractValue,
-    // that rely on z3 may be released after this function...
-    //
-    // DEINIT(Len);
-    // DEINIT(SolverAssumptions);
-    // DEINIT(Solver);
-    // DEINIT(Ctx);
+    // do not delete the context of the main thread now, because some structures,
+    // e.g., AbstractValue, that rely on z3 may be released after this function...
+}
+
+void Z3::statistics() {
+    Z3SolverCache::report();
+    Z3::simplify_statistics();
+}
+
+static z3::expr translate(Z3Context &From, Z3Context &To, const z3::expr &E, std::set<unsigned> &Visited);
+
+/// carry the kinds of the symbols in the expr, and the conditions of the phis, over to the target context
+static void translate_symbols(Z3Context &From, Z3Context &To, const z3::expr &E, std::set<unsigned> &Visited) {
+    std::vector<z3::expr> Stack;
+    Stack.push_back(E);
+    while (!Stack.empty()) {
+        auto Top = Stack.back();
+        Stack.pop_back();
+        if (!Top.is_app() || !Visited.insert(Top.id()).second) continue;
+
+        if (auto *Info = From.symbol(Top)) {
+            auto Decl = Top.decl();
+            auto *ToDecl = Z3_to_func_decl(To.Ctx, Z3_translate(From.Ctx, Z3_func_decl_to_ast(From.Ctx, Decl), To.Ctx));
+            z3::func_decl NewDecl(To.Ctx, ToDecl);
+            To.record(NewDecl, Info->Kind, Info->PhiID);
+            if (Info->Kind == Z3Symbol::SK_Length && !To.Len) {
+                To.Len.reset(new z3::expr(NewDecl()));
+            } else if (Info->Kind == Z3Symbol::SK_Phi && !To.PhiID2CondMap.count(Info->PhiID)) {
+                auto It = From.PhiID2CondMap.find(Info->PhiID);
+                if (It != From.PhiID2CondMap.end()) {
+                    // insert before translating the conditions, which may refer to the phi itself
+                    auto &CondVec = To.PhiID2CondMap.emplace(Info->PhiID, z3::expr_vector(To.Ctx)).first->second;
+                    for (auto Cond: It->second) CondVec.push_back(translate(From, To, Cond, Visited));
+                }
+            }
+        }
+
+        for (unsigned K = 0; K < Top.num_args(); ++K) Stack.push_back(Top.arg(K));
+    }
+}
+
+static z3::expr translate(Z3Context &From, Z3Context &To, const z3::expr &E, std::set<unsigned> &Visited) {
+    z3::expr Ret(To.Ctx, Z3_translate(From.Ctx, E, To.Ctx));
+    To.Ctx.check_error();
+    translate_symbols(From, To, E, Visited);
+    return Ret;
+}
+
+static Z3Context &owner(Z3_context C) {
+    auto It = Contexts.find(C);
+    assert(It != Contexts.end() && "the expr is not created by the z3 facade!");
+    return *It->second;
+}
+
+z3::expr Z3::translate(const z3::expr &E) {
+    auto &To = Z3Context::get();
+    if ((Z3_context) E.ctx() == (Z3_context) To.Ctx) return E;
+
+    std::lock_guard<std::mutex> L(ContextLock);
+    std::set<unsigned> Visited;
+    return ::translate(owner(E.ctx()), To, E, Visited);
+}
+
+z3::expr_vector Z3::translate(const z3::expr_vector &V) {
+    auto &To = Z3Context::get();
+    if ((Z3_context) V.ctx() == (Z3_context) To.Ctx) return V;
+
+    std::lock_guard<std::mutex> L(ContextLock);
+    auto &From = owner(V.ctx());
+    std::set<unsigned> Visited;
+    z3::expr_vector Ret(To.Ctx);
+    for (auto E: V) Ret.push_back(::translate(From, To, E, Visited));
+    return Ret;
+}
+
+Z3::TranslationLock::TranslationLock() {
+    ContextLock.lock();
+}
+
+Z3::TranslationLock::~TranslationLock() {
+    ContextLock.unlock();
+}
+
+void Z3Symbol::record(const z3::func_decl &Decl, Kind K, unsigned PhiID) {
+    Z3Context::get().record(Decl, K, PhiID);
+}
+
+Z3Symbol::Kind Z3Symbol::kind(const z3::expr &E) {
+    assert(owned(E));
+    auto *Info = Z3Context::get().symbol(E);
+    return Info ? Info->Kind : SK_None;
+}
+
+unsigned Z3Symbol::phi_id(const z3::expr &E) {
+    assert(kind(E) == SK_Phi);
+    return Z3Context::get().symbol(E)->PhiID;
 }
 
 z3::expr Z3::bv_val(unsigned V, unsigned Size) {
@@ -78,7 +255,11 @@ z3::expr Z3::bv_val(int64_t V, unsigned Size) {
 }
 
 z3::expr Z3::bv_const(const char *Name, unsigned int Size) {
-    return ctx().bv_const(Name, Size);
+    auto Const = ctx().bv_const(Name, Size);
+    // named objects created by users may be the length or the state
+    if (strcmp(Name, LENGTH) == 0) Z3Symbol::record(Const.decl(), Z3Symbol::SK_Length);
+    else if (strcmp(Name, STATE) == 0) Z3Symbol::record(Const.decl(), Z3Symbol::SK_State);
+    return Const;
 }
 
 z3::expr Z3::bool_val(bool B) {
@@ -86,21 +267,25 @@ z3::expr Z3::bool_val(bool B) {
 }
 
 z3::expr Z3::free_bool() {
-    static unsigned I = 0;
+    static std::atomic<unsigned> I{0}; // shared by all contexts so that translated free variables never clash
     std::string Name(FREE_VAR);
     Name.append(std::to_string(I++));
-    return ctx().bool_const(Name.c_str());
+    auto Const = ctx().bool_const(Name.c_str());
+    Z3Symbol::record(Const.decl(), Z3Symbol::SK_Free);
+    return Const;
 }
 
 z3::expr Z3::free_bv(unsigned Bitwidth) {
-    static unsigned K = 0;
+    static std::atomic<unsigned> K{0};
     std::string Name(FREE_VAR);
     Name.append(std::to_string(K++));
-    return ctx().bv_const(Name.c_str(), Bitwidth);
+    auto Const = ctx().bv_const(Name.c_str(), Bitwidth);
+    Z3Symbol::record(Const.decl(), Z3Symbol::SK_Free);
+    return Const;
 }
 
 bool Z3::is_free(const z3::expr &E) {
-    return E.is_const() && E.to_string().find(FREE_VAR) != std::string::npos;
+    return Z3Symbol::kind(E) == Z3Symbol::SK_Free;
 }
 
 z3::expr Z3::k() {
@@ -117,21 +302,23 @@ z3::expr Z3::substitute(const z3::expr &E, const z3::expr &F, const z3::expr &T)
 }
 
 z3::expr Z3::index_var() {
-    static unsigned J = 0;
+    static std::atomic<unsigned> J{0};
     std::string Name(INDEX_VAR);
     Name.append(std::to_string(J++));
-    return ctx().bv_const(Name.c_str(), 64);
+    auto Const = ctx().bv_const(Name.c_str(), 64);
+    Z3Symbol::record(Const.decl(), Z3Symbol::SK_IndexVar);
+    return Const;
 }
 
 bool Z3::is_index_var(const z3::expr &E) {
-    return E.is_bv() && E.is_const() && E.to_string().find(INDEX_VAR) != std::string::npos;
+    return Z3Symbol::kind(E) == Z3Symbol::SK_IndexVar;
 }
 
 z3::expr Z3::length(unsigned Bitwidth) {
+    auto &Len = Z3Context::get().Len;
     if (!Len) {
         assert(Bitwidth != UINT32_MAX);
-        Len = new z3::expr(ctx());
-        *Len = Z3::bv_const(LENGTH, Bitwidth);
+        Len.reset(new z3::expr(Z3::bv_const(LENGTH, Bitwidth)));
         return *Len;
     } else {
         assert((Bitwidth == UINT32_MAX || Len->get_sort().bv_size() == Bitwidth) &&
@@ -141,42 +328,45 @@ z3::expr Z3::length(unsigned Bitwidth) {
 }
 
 bool Z3::is_length(const z3::expr &E) {
-    return E.is_bv() && E.is_const() && E.to_string() == LENGTH;
+    return Z3Symbol::kind(E) == Z3Symbol::SK_Length;
 }
 
 z3::expr Z3::base(unsigned K) {
     std::string Name(BASE);
     Name.append(std::to_string(K));
-    return Z3::bv_const(Name.c_str(), 64);
+    auto Const = ctx().bv_const(Name.c_str(), 64);
+    Z3Symbol::record(Const.decl(), Z3Symbol::SK_Base);
+    return Const;
 }
 
 bool Z3::is_base(const z3::expr &E) {
-    return E.is_bv() && E.is_const() && E.to_string().find(BASE) == 0;
+    return Z3Symbol::kind(E) == Z3Symbol::SK_Base;
 }
 
 z3::expr Z3::transit_to(const z3::expr &E) {
     auto Transfer = z3::function(STATE_TRANSITION, E.get_sort(), Z3::bool_val(true).get_sort());
+    Z3Symbol::record(Transfer, Z3Symbol::SK_TransitTo);
     return Transfer(E);
 }
 
 bool Z3::is_transit_to(const z3::expr &E) {
-    if (E.num_args() == 1)
-        return E.decl().name().str() == STATE_TRANSITION;
-    return false;
+    return Z3Symbol::kind(E) == Z3Symbol::SK_TransitTo && E.num_args() == 1;
 }
 
 bool Z3::is_state(const z3::expr &E) {
-    return E.is_bv() && E.is_const() && E.to_string() == STATE;
+    return Z3Symbol::kind(E) == Z3Symbol::SK_State;
 }
 
 z3::expr Z3::trip_count(unsigned K) {
     std::string Name(TRIP_COUNT);
     Name.append(std::to_string(K));
-    return Z3::bv_const(Name.c_str(), 64);
+    auto Const = ctx().bv_const(Name.c_str(), 64);
+    Z3Symbol::record(Const.decl(), Z3Symbol::SK_TripCount);
+    return Const;
 }
 
 bool Z3::is_trip_count(const z3::expr &E) {
-    return E.is_bv() && E.is_const() && E.to_string().find(TRIP_COUNT) == 0;
+    return Z3Symbol::kind(E) == Z3Symbol::SK_TripCount;
 }
 
 z3::expr_vector Z3::vec() {
@@ -194,13 +384,14 @@ z3::expr Z3::packing(const char *Name, const z3::expr_vector &Args, unsigned Ret
 
 z3::expr Z3::naming(const z3::expr &E, const char *Name) {
     auto Decl = z3::function(NAME, E.get_sort(), E.get_sort());
+    Z3Symbol::record(Decl, Z3Symbol::SK_Naming);
     auto Naming = Decl(E);
     auto NameExpr = Z3::bv_const(Name, E.get_sort().bv_size());
     return Naming == NameExpr;
 }
 
 bool Z3::is_naming(const z3::expr &E) {
-    return E.num_args() == 1 && E.decl().name().str() == NAME;
+    return Z3Symbol::kind(E) == Z3Symbol::SK_Naming && E.num_args() == 1;
 }
 
 bool Z3::is_naming_eq(const z3::expr &E) {
@@ -210,11 +401,13 @@ bool Z3::is_naming_eq(const z3::expr &E) {
 }
 
 unsigned Z3::id(const z3::expr &E) {
-    return Z3_get_ast_id(ctx(), E);
+    assert(owned(E));
+    return Z3_get_ast_id(E.ctx(), E);
 }
 
 bool Z3::same(const z3::expr &E1, const z3::expr &E2) {
-    return Z3_get_ast_id(ctx(), E1) == Z3_get_ast_id(ctx(), E2);
+    assert(owned(E1) && owned(E2));
+    return Z3_get_ast_id(E1.ctx(), E1) == Z3_get_ast_id(E2.ctx(), E2);
 }
 
 bool Z3::is_numeral_i64(const z3::expr &E, int64_t &R) {
@@ -651,7 +844,7 @@ std::string Z3::to_string(const z3::expr &Expr, bool Easy) {
     }
 }
 
-static Z3::Z3Format PrintFormat = Z3::ZF_Easy;
+static thread_local Z3::Z3Format PrintFormat = Z3::ZF_Easy;
 
 raw_ostream &operator<<(llvm::raw_ostream &O, const Z3::Z3Format &F) {
     PrintFormat = F;
@@ -667,7 +860,7 @@ raw_ostream &operator<<(llvm::raw_ostream &O, const z3::expr &E) {
             O << Z3::to_string(E);
             break;
         case Z3::ZF_SMTLib:
-            O << Z3_benchmark_to_smtlib_string(*Ctx, 0, 0, 0, 0, 0, 0, E);
+            O << Z3_benchmark_to_smtlib_string(ctx(), 0, 0, 0, 0, 0, 0, E);
             break;
     }
     PrintFormat = Z3::ZF_Easy; // reset
@@ -679,19 +872,47 @@ void Z3Solver::addAssumption(const z3::expr &A) {
 }
 
 void Z3Solver::clearAssumptions() {
-    delete SolverAssumptions;
-    SolverAssumptions = nullptr;
+    Z3Context::get().SolverAssumptions.reset();
 }
 
-bool Z3Solver::check(const z3::expr &A, std::vector<uint8_t> &Ret) {
-    solver().reset();
-    solver().add(A);
-    auto Result = solver().check();
-    if (Result != z3::sat) {
-        Ret.clear();
-        return false;
-    }
-    auto Model = solver().get_model();
+void Z3Solver::push() {
+    scoped_solver().push();
+    solver_scopes()++;
+}
+
+void Z3Solver::pop(unsigned N) {
+    assert(N <= solver_scopes());
+    scoped_solver().pop(N);
+    solver_scopes() -= N;
+}
+
+void Z3Solver::add(const z3::expr &A) {
+    assert(solver_scopes() > 0 && "please push a scope before adding assertions!");
+    scoped_solver().add(A);
+}
+
+bool Z3Solver::check() {
+    // the live assertions form the whole query, e.g., a path condition, thus it shares the cache with the one-shot
+    // queries on the same conjuncts
+    auto &S = scoped_solver();
+    auto Key = Z3SolverCache::key(S.assertions(), "sat");
+    bool Sat;
+    if (Z3SolverCache::lookup(Key, Sat, nullptr)) return Sat;
+
+    ProfileScope Scope("z3", "check");
+    auto Begin = std::chrono::steady_clock::now();
+    auto Result = S.check();
+    auto Micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Begin);
+    if (Result != z3::unknown) Z3SolverCache::insert(Key, Result == z3::sat, nullptr, Micros.count());
+    // unknown is regarded as sat, since callers use it to prune infeasible paths
+    return Result != z3::unsat;
+}
+
+unsigned Z3Solver::scopes() {
+    return solver_scopes();
+}
+
+static void decode_model(const z3::model &Model, std::vector<uint8_t> &Ret) {
     std::vector<bool> Set(Ret.size(), false);
     for (unsigned K = 0; K < Model.num_consts(); ++K) {
         auto Decl = Model.get_const_decl(K);
@@ -735,27 +956,51 @@ bool Z3Solver::check(const z3::expr &A, std::vector<uint8_t> &Ret) {
             }
         }
     }
-    return true;
 }
 
-bool Z3Solver::check(const z3::expr &A) {
-    solver().reset();
-    solver().add(A);
-    return solver().check() == z3::sat;
-}
+/// all one-shot queries go through here, so that they share the query cache
+static bool check_query(const z3::expr_vector &Query, std::vector<uint8_t> *Ret) {
+    auto Key = Z3SolverCache::key(Query, Ret ? "model." + std::to_string(Ret->size()) : "sat");
+    bool Sat;
+    if (Z3SolverCache::lookup(Key, Sat, Ret)) return Sat;
 
-bool Z3Solver::check(const std::vector<z3::expr> &V) {
+    ProfileScope Profile("z3", "check");
+    auto Begin = std::chrono::steady_clock::now();
     solver().reset();
-    for (auto &E: V) solver().add(E);
+    for (auto E: Query) solver().add(E);
     auto Result = solver().check();
     assert(Result != z3::unknown);
+    if (Result == z3::sat && Ret) {
+        decode_model(solver().get_model(), *Ret);
+    } else if (Result != z3::sat && Ret) {
+        Ret->clear();
+    }
+    auto Micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Begin);
+
+    // unknown results depend on resource limits, do not remember them when assertions are disabled
+    if (Result != z3::unknown)
+        Z3SolverCache::insert(Key, Result == z3::sat, Ret, Micros.count());
     return Result == z3::sat;
 }
 
+bool Z3Solver::check(const z3::expr &A, std::vector<uint8_t> &Ret) {
+    auto Query = Z3::vec();
+    Query.push_back(A);
+    return check_query(Query, &Ret);
+}
+
+bool Z3Solver::check(const z3::expr &A) {
+    auto Query = Z3::vec();
+    Query.push_back(A);
+    return check_query(Query, nullptr);
+}
+
+bool Z3Solver::check(const std::vector<z3::expr> &V) {
+    auto Query = Z3::vec();
+    for (auto &E: V) Query.push_back(E);
+    return check_query(Query, nullptr);
+}
+
 bool Z3Solver::check(const z3::expr_vector &V) {
-    solver().reset();
-    for (auto E: V) solver().add(E);
-    auto Result = solver().check();
-    assert(Result != z3::unknown);
-    return Result == z3::sat;
+    return check_query(V, nullptr);
 }
@@ -19,6 +19,7 @@
 #include <llvm/Support/CommandLine.h>
 
 #include "Z3Macro.h"
+#include "Z3Symbol.h"
 
 static cl::opt<bool> CompleteStrLen(
         "popeye-enable-z3-strlen",
@@ -64,13 +65,14 @@ z3::expr Z3::byte_array_range(const z3::expr &Array, const z3::expr &F, const z3
 
     std::string Range(BYTE_ARRAY_RANGE);
     auto RangeFunc = z3::function(Range.c_str(), SortVec.size(), &SortVec[0], SortVec[1]);
+    Z3Symbol::record(RangeFunc, Z3Symbol::SK_ByteArrayRange);
     return RangeFunc(IV);
 }
 
 bool Z3::is_byte_array_range(const z3::expr &E) {
     if (E.num_args() != 3) return false;
     if (!E.arg(0).is_array()) return false;
-    return E.decl().name().str() == BYTE_ARRAY_RANGE;
+    return Z3Symbol::kind(E) == Z3Symbol::SK_ByteArrayRange;
 }
 
 bool Z3::is_byte_eq_zero(const z3::expr &E) {
@@ -87,10 +89,13 @@ bool Z3::is_byte_eq_minus_one(const z3::expr &E) {
     return true;
 }
 
+static int indexLessThan(const z3::expr &A, const z3::expr &B, std::string *ErrMsg);
+
 static int truncLessThan(const z3::expr_vector &V1, const z3::expr_vector &V2) {
     // 1 - true
     // 0 - false
     // -1 - unknown
+    // -2 - not comparable
     unsigned Bits2Remove = 0;
     for (auto E: V1) {
         if (E.decl().decl_kind() == Z3_OP_CONCAT) {
@@ -178,10 +183,26 @@ static int truncLessThan(const z3::expr_vector &V1, const z3::expr_vector &V2) {
     };
     auto N1 = BvSum(NV1);
     auto N2 = BvSum(NV2);
-    return Z3::byte_array_element_index_less_than(N1, N2) ? 1 : 0;
+    auto Ret = indexLessThan(N1, N2, nullptr);
+    return Ret == -1 ? -2 : Ret;
 }
 
 bool Z3::byte_array_element_index_less_than(const z3::expr &A, const z3::expr &B) {
+    std::string ErrMsg;
+    auto Ret = indexLessThan(A, B, &ErrMsg);
+    if (Ret == -1)
+        throw std::runtime_error(ErrMsg);
+    return Ret;
+}
+
+int Z3::byte_array_element_index_try_less_than(const z3::expr &A, const z3::expr &B) {
+    return indexLessThan(A, B, nullptr);
+}
+
+static int indexLessThan(const z3::expr &A, const z3::expr &B, std::string *ErrMsg) {
+    // 1 - true
+    // 0 - false
+    // -1 - not comparable
 //    if (Z3::to_string(B) == "3 + K1 x 9 + strlem" && Z3::to_string(A) == "6 + 9 x K1 + strlem + K1 x strlem") {
 //        outs() << "";
 //    }
@@ -357,12 +378,12 @@ bool Z3::byte_array_element_index_less_than(const z3::expr &A, const z3::expr &B
             return false;
         } else {
             auto Ret = truncLessThan(O1Ops, O2Ops);
-            if (Ret != -1) {
+            if (Ret >= 0) {
                 LLVM_DEBUG(dbgs() << A << " < " << B << " yields " << Ret << " (*)!\n");
                 return Ret;
-            } else {
+            } else if (Ret == -1) {
                 Ret = truncLessThan(O2Ops, O1Ops);
-                if (Ret != -1) {
+                if (Ret >= 0) {
                     LLVM_DEBUG(dbgs() << A << " < " << B << " yields " << !Ret << " (*)!\n");
                     return Ret == 0 ? 1 : 0;
                 }
@@ -377,16 +398,17 @@ bool Z3::byte_array_element_index_less_than(const z3::expr &A, const z3::expr &B
                 dbgs() << "\n-----\n"
         );
 
-        std::string ErrMsg;
-        raw_string_ostream Str(ErrMsg);
-        Str << "Error: not comparable...\n\n";
-        Str << A << " < " << B << "\n-----\nO1Ops: \n";
-        for (auto X: O1Ops) Str << X << ", ";
-        Str << "\n-----\nO2Ops: \n";
-        for (auto X: O2Ops) Str << X << ", ";
-        Str << "\n-----\n";
-        Str.flush();
-        throw std::runtime_error(ErrMsg);
+        if (ErrMsg) {
+            raw_string_ostream Str(*ErrMsg);
+            Str << "Error: not comparable...\n\n";
+            Str << A << " < " << B << "\n-----\nO1Ops: \n";
+            for (auto X: O1Ops) Str << X << ", ";
+            Str << "\n-----\nO2Ops: \n";
+            for (auto X: O2Ops) Str << X << ", ";
+            Str << "\n-----\n";
+            Str.flush();
+        }
+        return -1;
     }
 }
 
@@ -0,0 +1,86 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUPPORT_Z3CONTEXT_H
+#define SUPPORT_Z3CONTEXT_H
+
+#include <map>
+#include <memory>
+#include <vector>
+#include "Support/LRUCache.h"
+#include "Support/Z3.h"
+#include "Z3Symbol.h"
+
+/// the operands are kept to pin their ast ids, so that a cached id pair never refers to other exprs
+struct Z3SimplifyEntry {
+    z3::expr E1;
+    z3::expr E2;
+    z3::expr Result;
+};
+
+/// Everything the z3 facade keeps for a z3 context. Each thread works in its own context, which is created at the
+/// first use of the facade in the thread and released when the thread exits. The context of the main thread lives
+/// until the process exits, because some global structures keep exprs. Exprs of different contexts must never be
+/// mixed, use Z3::translate to move an expr into the context of the current thread.
+class Z3Context {
+public:
+    struct SymbolInfo {
+        Z3Symbol::Kind Kind = Z3Symbol::SK_None;
+        unsigned PhiID = 0;
+    };
+
+    /// declared first so that it is destructed after all exprs below
+    z3::context Ctx;
+
+    std::vector<SymbolInfo> SymbolTable;
+    /// keep recorded decls alive so that their ids are never reused
+    z3::func_decl_vector SymbolDecls;
+
+    std::unique_ptr<z3::expr> Len;
+
+    /// one-shot queries reset this solver, while the incremental scopes live in the other one
+    std::unique_ptr<z3::solver> Solver;
+    std::unique_ptr<z3::solver> ScopedSolver;
+    std::unique_ptr<z3::expr_vector> SolverAssumptions;
+    unsigned SolverScopes = 0;
+
+    /// phi id -> the conditions of its incoming values
+    std::map<unsigned, z3::expr_vector> PhiID2CondMap;
+
+    std::unique_ptr<LRUCache<uint64_t, Z3SimplifyEntry>> SimplifyCache;
+
+public:
+    Z3Context();
+
+    ~Z3Context();
+
+    Z3Context(const Z3Context &) = delete;
+
+    Z3Context &operator=(const Z3Context &) = delete;
+
+    /// the context of the current thread
+    static Z3Context &get();
+
+    void record(const z3::func_decl &, Z3Symbol::Kind, unsigned PhiID);
+
+    const SymbolInfo *symbol(Z3_func_decl) const;
+
+    const SymbolInfo *symbol(const z3::expr &) const;
+};
+
+#endif //SUPPORT_Z3CONTEXT_H
@@ -17,8 +17,87 @@
  */
 
 #include "Support/Debug.h"
+#include "Z3Context.h"
 #include "Z3Macro.h"
 
+static cl::opt<unsigned> SimplifyCacheSize("popeye-simplify-cache-size",
+                                           cl::desc("the max number of cached results of pairwise simplification, "
+                                                    "0 to disable the cache"),
+                                           cl::init(1u << 16));
+
+/// collect the atoms an expr references, i.e., uninterpreted constants (except arrays, because all
+/// message bytes are selected from the same array), selects, and applications of uninterpreted functions
+static void collect_atoms(const z3::expr &Expr, std::vector<unsigned> &Atoms) {
+    std::set<unsigned> Visited;
+    std::vector<z3::expr> Stack;
+    Stack.push_back(Expr);
+    while (!Stack.empty()) {
+        auto Top = Stack.back();
+        Stack.pop_back();
+        if (!Visited.insert(Z3::id(Top)).second) continue;
+        if (!Top.is_app()) continue;
+
+        unsigned FirstArg = 0;
+        switch (Top.decl().decl_kind()) {
+            case Z3_OP_UNINTERPRETED:
+                if (Top.is_const()) {
+                    if (!Top.is_array()) Atoms.push_back(Z3::id(Top));
+                    continue;
+                }
+                Atoms.push_back(Z3::id(Top));
+                break;
+            case Z3_OP_SELECT:
+                Atoms.push_back(Z3::id(Top));
+                FirstArg = 1; // skip the array
+                break;
+            default:
+                break;
+        }
+        for (unsigned K = FirstArg; K < Top.num_args(); ++K) Stack.push_back(Top.arg(K));
+    }
+}
+
+namespace {
+/// index conjuncts by their atoms, so that a conjunct is only compared with those sharing an atom with it.
+/// the pairwise simplification relies on syntactically shared operands, thus skipping others loses nothing.
+class ConjunctIndex {
+private:
+    std::map<unsigned, std::vector<unsigned>> AtomMap; // atom -> conjuncts referencing it
+    std::vector<unsigned> GroundVec; // conjuncts without any atom
+
+public:
+    explicit ConjunctIndex(const z3::expr_vector &Vec) {
+        for (unsigned K = 0; K < Vec.size(); ++K) update(K, Vec[K]);
+    }
+
+    /// call when the k-th conjunct is changed, stale atoms are kept, which is conservative
+    void update(unsigned K, const z3::expr &E) {
+        std::vector<unsigned> Atoms;
+        collect_atoms(E, Atoms);
+        if (Atoms.empty()) GroundVec.push_back(K);
+        for (auto Atom: Atoms) AtomMap[Atom].push_back(K);
+    }
+
+    /// return the conjuncts that may interact with the expr, in ascending order
+    std::vector<unsigned> related(const z3::expr &E) const {
+        std::vector<unsigned> Atoms;
+        collect_atoms(E, Atoms);
+        std::vector<unsigned> Ret;
+        if (Atoms.empty()) {
+            Ret = GroundVec;
+        } else {
+            for (auto Atom: Atoms) {
+                auto It = AtomMap.find(Atom);
+                if (It != AtomMap.end()) Ret.insert(Ret.end(), It->second.begin(), It->second.end());
+            }
+        }
+        std::sort(Ret.begin(), Ret.end());
+        Ret.erase(std::unique(Ret.begin(), Ret.end()), Ret.end());
+        return Ret;
+    }
+};
+}
+
 z3::expr Z3::simplify(const z3::expr_vector &Orig) {
     z3::expr_vector NewVec = Z3::vec();
     for (auto E: Orig) {
@@ -29,10 +108,11 @@ z3::expr Z3::simplify(const z3::expr_vector &Orig) {
     POPEYE_DEBUG_WITH_TYPE("Z3Simplify", dbgs() << ">>> Original Exprs:" << "\n");
     POPEYE_DEBUG_WITH_TYPE("Z3Simplify", for (auto E: NewVec) dbgs() << "\t" << E << "\n");
     auto False = Z3::bool_val(false);
-    for (int I = 0; I < NewVec.size(); ++I) {
+    ConjunctIndex Index(NewVec);
+    for (unsigned I = 0; I < NewVec.size(); ++I) {
         auto ExprI = NewVec[I];
         bool FalseFound = false;
-        for (int J = 0; J < NewVec.size(); ++J) {
+        for (auto J: Index.related(ExprI)) {
             if (I == J) continue;
             auto ExprJ = NewVec[J];
             auto ExprJAfterSimplify = Z3::simplify(ExprI, ExprJ);
@@ -42,6 +122,7 @@ z3::expr Z3::simplify(const z3::expr_vector &Orig) {
                 break;
             } else if (!Z3::same(ExprJ, ExprJAfterSimplify)) {
                 NewVec.set(J, ExprJAfterSimplify);
+                Index.update(J, ExprJAfterSimplify);
             }
         }
         if (FalseFound) break;
@@ -61,9 +142,10 @@ z3::expr Z3::simplify(const z3::expr_vector &Orig) {
     POPEYE_DEBUG_WITH_TYPE("Z3Simplify", dbgs() << ">>> Exprs (2):" << "\n");
     POPEYE_DEBUG_WITH_TYPE("Z3Simplify", for (auto E: NewVec) dbgs() << "\t" << E << "\n");
 
+    ConjunctIndex SubstIndex(NewVec);
     while (true) {
         bool Changed = false;
-        for (int I = 0; I < NewVec.size(); ++I) {
+        for (unsigned I = 0; I < NewVec.size(); ++I) {
             auto Arg = NewVec[I];
             z3::expr_vector From = Z3::vec();
             z3::expr_vector To = Z3::vec();
@@ -85,13 +167,15 @@ z3::expr Z3::simplify(const z3::expr_vector &Orig) {
                 To.push_back(Z3::bool_val(false));
             }
             if (From.empty()) continue;
-            for (int J = 0; J < NewVec.size(); ++J) {
+            // only conjuncts containing the substituted terms, which share their atoms, can change
+            for (auto J: SubstIndex.related(Arg)) {
                 if (I == J) continue;
                 auto ExprJ = NewVec[J];
                 if (Z3::is_naming_eq(ExprJ)) continue;
                 auto ExprJAfterSimplify = ExprJ.substitute(From, To).simplify();
                 if (!Z3::same(ExprJAfterSimplify, ExprJ)) {
                     NewVec.set(J, ExprJAfterSimplify);
+                    SubstIndex.update(J, ExprJAfterSimplify);
                     if (!Changed) Changed = true;
                 }
             }
@@ -999,7 +1083,30 @@ static inline z3::expr simplify_sle(const z3::expr &E1, const z3::expr &E2) {
 z3::expr Z3::simplify(const z3::expr &E1, const z3::expr &E2) {
     if (Z3::is_naming_eq(E1) || Z3::is_naming_eq(E2))
         return E2;
+    if (SimplifyCacheSize == 0)
+        return simplify_pair(E1, E2);
+
+    auto &SimplifyCache = Z3Context::get().SimplifyCache;
+    if (!SimplifyCache) SimplifyCache.reset(new LRUCache<uint64_t, Z3SimplifyEntry>(SimplifyCacheSize));
+    uint64_t Key = ((uint64_t) Z3::id(E1) << 32) | Z3::id(E2);
+    if (auto *Entry = SimplifyCache->get(Key)) return Entry->Result;
+    auto Result = simplify_pair(E1, E2);
+    SimplifyCache->put(Key, {E1, E2, Result});
+    return Result;
+}
+
+void Z3::atoms(const z3::expr &Expr, std::vector<unsigned> &Atoms) {
+    collect_atoms(Expr, Atoms);
+}
+
+void Z3::simplify_statistics() {
+    auto &SimplifyCache = Z3Context::get().SimplifyCache;
+    if (!SimplifyCache) return;
+    POPEYE_INFO("Simplify cache: " << SimplifyCache->hits() << " hits, " << SimplifyCache->misses() << " misses, "
+                                   << SimplifyCache->evictions() << " evictions!");
+}
 
+z3::expr Z3::simplify_pair(const z3::expr &E1, const z3::expr &E2) {
     auto NewE1 = normalize(E1);
     auto NewE2 = normalize(E2);
 
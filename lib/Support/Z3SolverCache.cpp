@@ -0,0 +1,186 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "Support/Debug.h"
+#include "Z3Macro.h"
+#include "Z3SolverCache.h"
+
+static cl::opt<std::string> SolverCacheDir("popeye-solver-cache",
+                                           cl::desc("persist solver results in the directory across runs"),
+                                           cl::value_desc("dir"), cl::init(""));
+
+namespace {
+struct CacheEntry {
+    bool Sat;
+    std::vector<uint8_t> Model;
+    uint64_t Micros; // the time the solver took on the query
+};
+}
+
+/// shared by the contexts of all threads, since queries are identified by their text
+static std::mutex CacheLock;
+static std::unordered_map<std::string, CacheEntry> Cache;
+static bool CacheLoaded = false;
+static std::unique_ptr<raw_fd_ostream> CacheStream; // opened at the first insertion, guarded by CacheLock
+static bool CacheStreamFailed = false;
+static uint64_t CacheHits = 0;
+static uint64_t CacheMisses = 0;
+static uint64_t CacheSavedMicros = 0;
+
+static std::string cache_file() {
+    SmallString<256> File(SolverCacheDir.getValue());
+    sys::path::append(File, "popeye.solver.cache");
+    return File.str().str();
+}
+
+/// each line of the cache file is "key sat micros model", where model is "m" followed by hex bytes, or "-"
+static void load() {
+    CacheLoaded = true;
+    if (SolverCacheDir.empty()) return;
+    auto BufferOrErr = MemoryBuffer::getFile(cache_file());
+    if (!BufferOrErr) return;
+
+    SmallVector<StringRef, 64> Lines;
+    BufferOrErr.get()->getBuffer().split(Lines, '\n', -1, false);
+    for (auto Line: Lines) {
+        SmallVector<StringRef, 4> Fields;
+        Line.split(Fields, ' ', -1, false);
+        if (Fields.size() != 4) continue;
+
+        CacheEntry Entry;
+        Entry.Sat = Fields[1] == "1";
+        if (Fields[2].getAsInteger(10, Entry.Micros)) continue;
+        if (Fields[3].startswith("m")) {
+            auto Hex = Fields[3].substr(1);
+            if (Hex.size() % 2) continue;
+            for (unsigned K = 0; K < Hex.size(); K += 2) {
+                unsigned Byte;
+                if (Hex.substr(K, 2).getAsInteger(16, Byte)) break;
+                Entry.Model.push_back((uint8_t) Byte);
+            }
+        }
+        Cache[Fields[0].str()] = std::move(Entry);
+    }
+    POPEYE_INFO("Solver cache: " << Cache.size() << " entries loaded from " << cache_file());
+}
+
+/// the caller holds CacheLock
+static void persist(const std::string &Key, const CacheEntry &Entry, bool HasModel) {
+    if (SolverCacheDir.empty() || CacheStreamFailed) return;
+    if (!CacheStream) {
+        std::error_code EC;
+        if (!sys::fs::create_directories(SolverCacheDir.getValue()))
+            CacheStream.reset(new raw_fd_ostream(cache_file(), EC, sys::fs::OF_Append));
+        if (!CacheStream || EC) {
+            POPEYE_WARN("Cannot open the solver cache <" << cache_file() << "> for writing.");
+            CacheStream.reset();
+            CacheStreamFailed = true;
+            return;
+        }
+        // a line goes to the file by a single write, so that lines of processes sharing the file do not interleave
+        CacheStream->SetUnbuffered();
+    }
+
+    std::string Line;
+    raw_string_ostream LineStream(Line);
+    LineStream << Key << " " << (Entry.Sat ? "1" : "0") << " " << Entry.Micros << " ";
+    if (!HasModel) {
+        LineStream << "-";
+    } else {
+        LineStream << "m";
+        for (auto Byte: Entry.Model) LineStream << format_hex_no_prefix(Byte, 2);
+    }
+    LineStream << "\n";
+    auto &Str = LineStream.str();
+    CacheStream->write(Str.data(), Str.size());
+}
+
+/// renames free variables, e.g., fv123, to fv#0, fv#1, ... by their first occurrence
+static std::string normalize(const std::string &Str) {
+    std::string Ret;
+    Ret.reserve(Str.size());
+    std::unordered_map<std::string, unsigned> FreeVarMap;
+    size_t FreeVarLen = strlen(FREE_VAR);
+    size_t K = 0;
+    while (K < Str.size()) {
+        bool AtToken = K == 0 || !(isalnum(Str[K - 1]) || Str[K - 1] == '_' || Str[K - 1] == '.');
+        if (AtToken && Str.compare(K, FreeVarLen, FREE_VAR) == 0) {
+            size_t End = K + FreeVarLen;
+            while (End < Str.size() && isdigit(Str[End])) ++End;
+            if (End > K + FreeVarLen) {
+                auto It = FreeVarMap.insert({Str.substr(K, End - K), FreeVarMap.size()}).first;
+                Ret.append(FREE_VAR "#").append(std::to_string(It->second));
+                K = End;
+                continue;
+            }
+        }
+        Ret.push_back(Str[K++]);
+    }
+    return Ret;
+}
+
+std::string Z3SolverCache::key(const z3::expr_vector &Query, const std::string &Tag) {
+    MD5 Hash;
+    Hash.update(Tag);
+    for (auto E: Query) {
+        Hash.update(";");
+        Hash.update(normalize(E.to_string()));
+    }
+    MD5::MD5Result Res;
+    Hash.final(Res);
+    return Res.digest().str().str();
+}
+
+bool Z3SolverCache::lookup(const std::string &Key, bool &Sat, std::vector<uint8_t> *Model) {
+    std::lock_guard<std::mutex> L(CacheLock);
+    if (!CacheLoaded) load();
+    auto It = Cache.find(Key);
+    if (It == Cache.end()) {
+        CacheMisses++;
+        return false;
+    }
+    CacheHits++;
+    CacheSavedMicros += It->second.Micros;
+    Sat = It->second.Sat;
+    if (Model) *Model = It->second.Model;
+    return true;
+}
+
+void Z3SolverCache::insert(const std::string &Key, bool Sat, const std::vector<uint8_t> *Model, uint64_t Micros) {
+    std::lock_guard<std::mutex> L(CacheLock);
+    auto &Entry = Cache[Key];
+    Entry.Sat = Sat;
+    Entry.Model = Model ? *Model : std::vector<uint8_t>();
+    Entry.Micros = Micros;
+    persist(Key, Entry, Model != nullptr);
+}
+
+void Z3SolverCache::report() {
+    if (CacheHits + CacheMisses == 0) return;
+    POPEYE_INFO("Solver cache: " << CacheHits << " hits, " << CacheMisses << " misses, saving "
+                                 << CacheSavedMicros / 1000 << "ms of solving!");
+}
@@ -0,0 +1,44 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUPPORT_Z3SOLVERCACHE_H
+#define SUPPORT_Z3SOLVERCACHE_H
+
+#include <string>
+#include <vector>
+#include "Support/Z3.h"
+
+/// A content-addressed cache of solver results, held in memory and optionally
+/// persisted to the directory specified by -popeye-solver-cache.
+/// A query is identified by the md5 of its smt-lib text, in which free variables
+/// are renamed by their first occurrence, so that re-lifting the same code hits.
+class Z3SolverCache {
+public:
+    /// the tag distinguishes different kinds of queries on the same formulas
+    static std::string key(const z3::expr_vector &Query, const std::string &Tag);
+
+    /// returns true if the key is found, and then fills the result and the model (if not null)
+    static bool lookup(const std::string &Key, bool &Sat, std::vector<uint8_t> *Model);
+
+    static void insert(const std::string &Key, bool Sat, const std::vector<uint8_t> *Model, uint64_t Micros);
+
+    /// print hit/miss counters
+    static void report();
+};
+
+#endif //SUPPORT_Z3SOLVERCACHE_H
@@ -0,0 +1,50 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUPPORT_Z3SYMBOL_H
+#define SUPPORT_Z3SYMBOL_H
+
+#include "Support/Z3.h"
+
+/// A side table recording the kind of each symbol we create, indexed by the id of its declaration.
+/// The symbol classifiers in Z3 look up this table instead of parsing the names of symbols.
+class Z3Symbol {
+public:
+    enum Kind : uint8_t {
+        SK_None,
+        SK_Free,
+        SK_IndexVar,
+        SK_Length,
+        SK_Base,
+        SK_TripCount,
+        SK_State,
+        SK_TransitTo,
+        SK_Naming,
+        SK_Phi,
+        SK_ByteArrayRange,
+    };
+
+    /// call at the creation of a symbol, the phi id is only used for SK_Phi
+    static void record(const z3::func_decl &, Kind, unsigned PhiID = 0);
+
+    static Kind kind(const z3::expr &);
+
+    static unsigned phi_id(const z3::expr &);
+};
+
+#endif //SUPPORT_Z3SYMBOL_H
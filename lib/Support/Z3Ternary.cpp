@@ -16,10 +16,17 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "Z3Context.h"
 #include "Z3Macro.h"
+#include "Z3Symbol.h"
 #include "Support/Z3.h"
 
-static std::map<unsigned, z3::expr_vector> PhiID2CondMap;
+/// the conditions are exprs, so they are kept for each context
+static std::map<unsigned, z3::expr_vector> &phi_cond_map() {
+    return Z3Context::get().PhiID2CondMap;
+}
+
+/// blocks are bound while abstract interpreting the code in the main thread, and are only read afterwards
 static std::map<unsigned, std::pair<BasicBlock *, std::vector<BasicBlock *>>> PhiID2BlockMap;
 
 z3::expr Z3::ite(const z3::expr &C, const z3::expr &O1, const z3::expr &O2) {
@@ -119,13 +126,15 @@ z3::expr Z3::make_phi(unsigned ID, const z3::expr_vector &ValVec, const z3::expr
     std::string PhiDeclName(PHI".");
     PhiDeclName.append(std::to_string(ID));
     auto NewPhi = z3::function(PhiDeclName.c_str(), NewValVec.size(), &SortVec[0], SortVec[0]);
+    Z3Symbol::record(NewPhi, Z3Symbol::SK_Phi, ID);
     auto RetPhi = simplify_phi(NewPhi(NewValVec), CondVec);
     if (!Z3::is_phi(RetPhi)) return RetPhi;
 
     // we create a phi, so let's record the phi cond id
-    auto It = PhiID2CondMap.find(ID);
-    if (It == PhiID2CondMap.end()) {
-        PhiID2CondMap.insert(std::make_pair(ID, CondVec));
+    auto &CondMap = phi_cond_map();
+    auto It = CondMap.find(ID);
+    if (It == CondMap.end()) {
+        CondMap.insert(std::make_pair(ID, CondVec));
     } else {
         It->second = CondVec;
     }
@@ -134,39 +143,35 @@ z3::expr Z3::make_phi(unsigned ID, const z3::expr_vector &ValVec, const z3::expr
 }
 
 z3::expr Z3::make_phi(unsigned ID, const z3::expr_vector &ValVec) {
-    return make_phi(ID, ValVec, PhiID2CondMap.at(ID));
+    return make_phi(ID, ValVec, phi_cond_map().at(ID));
 }
 
 bool Z3::is_phi(const z3::expr &Expr) {
-    if (Expr.is_const()) return false;
-    auto DeclName = Expr.decl().name().str();
-    return StringRef(DeclName).startswith(PHI);
+    return Z3Symbol::kind(Expr) == Z3Symbol::SK_Phi;
 }
 
 bool Z3::same_phi(const z3::expr &O1, const z3::expr &O2) {
     if (O1.num_args() != O2.num_args()) return false;
     if (!Z3::is_phi(O1) || !Z3::is_phi(O2)) return false;
-    return O1.decl().name().str() == O2.decl().name().str();
+    return Z3Symbol::phi_id(O1) == Z3Symbol::phi_id(O2);
 }
 
 unsigned Z3::phi_id(const z3::expr &Expr) {
-    assert(is_phi(Expr));
-    auto DeclName = Expr.decl().name().str();
-    // phi.4, phi.15, etc.
-    std::string IDStr = StringRef(DeclName).substr(4).str();
-    return std::strtoul(IDStr.c_str(), nullptr, 10);
+    return Z3Symbol::phi_id(Expr);
 }
 
 unsigned Z3::phi_cond_id(unsigned PhiID, unsigned K) {
-    auto It = PhiID2CondMap.find(PhiID);
-    assert (It != PhiID2CondMap.end());
+    auto &CondMap = phi_cond_map();
+    auto It = CondMap.find(PhiID);
+    assert (It != CondMap.end());
     auto Cond = It->second[K];
     return Z3::id(Cond);
 }
 
 z3::expr_vector Z3::phi_cond(unsigned PhiID) {
-    auto It = PhiID2CondMap.find(PhiID);
-    if (It == PhiID2CondMap.end()) {
+    auto &CondMap = phi_cond_map();
+    auto It = CondMap.find(PhiID);
+    if (It == CondMap.end()) {
         return Z3::vec();
     } else {
         return It->second;
@@ -174,7 +179,7 @@ z3::expr_vector Z3::phi_cond(unsigned PhiID) {
 }
 
 bool Z3::has_phi(unsigned PhiID) {
-    return PhiID2CondMap.count(PhiID);
+    return phi_cond_map().count(PhiID);
 }
 
 void Z3::bind_phi_id(unsigned PhiID, BasicBlock *MergePoint, const std::vector<BasicBlock *> &Preds) {
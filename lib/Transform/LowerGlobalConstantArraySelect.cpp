@@ -28,8 +28,9 @@
 
 static cl::opt<unsigned> MaxConstantGlobalArray(
         "popeye-lcga-max",
-        cl::desc("set the max number of elements of a global array that we try to handle"),
-        cl::init(15));
+        cl::desc("set the max number of elements of a global array that we lower to a switch, "
+                 "larger arrays are modeled by the executor as a whole"),
+        cl::init(0));
 
 char LowerGlobalConstantArraySelect::ID = 0;
 static RegisterPass<LowerGlobalConstantArraySelect> X(DEBUG_TYPE, "G[a] -> switch(a) -> phi(G[x])");
@@ -0,0 +1,300 @@
+/*
+ *  Popeye lifts protocol source code in C to its specification in BNF
+ *  Copyright (C) 2022 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/InitLLVM.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <memory>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string> OutputFilename("o", cl::desc("<output bitcode file>"),
+                                           cl::init("-"), cl::value_desc("filename"));
+
+static cl::opt<bool> OutputAssembly("S", cl::desc("Write output as LLVM assembly"), cl::init(false));
+
+static cl::opt<std::string> EntryName("entry", cl::desc("the name of the entry function"),
+                                      cl::init("popeye_main_gen"));
+
+static cl::opt<unsigned> NumFields("fields", cl::desc("the number of fixed fields parsed by each level"),
+                                   cl::init(4));
+
+static cl::opt<unsigned> FieldWidth("field-width", cl::desc("the number of bytes of each fixed field, 1, 2, 4, or 8"),
+                                    cl::init(1));
+
+static cl::opt<unsigned> NumLengthPrefixed("length-prefixed",
+                                           cl::desc("the number of length-prefixed fields parsed by each level"),
+                                           cl::init(1));
+
+static cl::opt<unsigned> PayloadLength("payload-length",
+                                       cl::desc("the number of payload bytes each length-prefixed field checks one "
+                                                "by one, which the length must cover, 0 to skip the payload unchecked"),
+                                       cl::init(0));
+
+static cl::opt<unsigned> NumCases("switch-cases", cl::desc("the number of cases of each type-dispatch switch"),
+                                  cl::init(2));
+
+static cl::opt<unsigned> Depth("depth", cl::desc("the number of nested levels, each dispatching to the next by a "
+                                                 "switch and a call"),
+                               cl::init(1));
+
+static cl::opt<unsigned> NumLoops("tlv-loops", cl::desc("the number of count-prefixed tlv loops in the last level"),
+                                  cl::init(1));
+
+namespace {
+/// Generates a parser in the shape of the ones we lift, i.e., a function per level that consumes a message from a
+/// position and returns the new position or -1 if the message is malformed. Each level parses
+///
+///     fixed fields | length-prefixed fields | type | type-specific bytes | the next level
+///
+/// and the last level parses the tlv loops instead of dispatching by a type. The payload of a length-prefixed field
+/// is skipped unless -payload-length asks to check its leading bytes, which scales the message each level reads.
+class ParserGenerator {
+private:
+    Module &M;
+    IRBuilder<> B;
+    IntegerType *I8;
+    IntegerType *I64;
+    std::vector<Function *> Levels;
+
+    /// the states of the function being generated
+    Function *Func = nullptr;
+    Value *Msg = nullptr;
+    Value *Len = nullptr;
+    Value *Pos = nullptr; // an alloca promoted by mem2reg in popeye
+    BasicBlock *Fail = nullptr;
+
+public:
+    explicit ParserGenerator(Module &Mod) : M(Mod), B(Mod.getContext()) {
+        I8 = B.getInt8Ty();
+        I64 = B.getInt64Ty();
+    }
+
+    void generate() {
+        auto *LevelTy = FunctionType::get(I64, {I8->getPointerTo(), I64, I64}, false);
+        for (unsigned K = 0; K <= Depth; ++K) {
+            auto *F = Function::Create(LevelTy, GlobalValue::InternalLinkage, "parse_level" + Twine(K), M);
+            F->getArg(0)->setName("msg");
+            F->getArg(1)->setName("len");
+            F->getArg(2)->setName("pos");
+            Levels.push_back(F);
+        }
+        for (unsigned K = 0; K <= Depth; ++K) generateLevel(K);
+        generateEntry();
+    }
+
+private:
+    void generateEntry() {
+        auto MakeMsg = M.getOrInsertFunction("popeye_make_message", FunctionType::get(I8->getPointerTo(), true));
+        auto MakeLen = M.getOrInsertFunction("popeye_make_message_length", FunctionType::get(I64, false));
+        auto *F = Function::Create(FunctionType::get(B.getInt32Ty(), false), GlobalValue::ExternalLinkage,
+                                   EntryName.getValue(), M);
+        B.SetInsertPoint(BasicBlock::Create(M.getContext(), "entry", F));
+        auto *Message = B.CreateCall(MakeMsg, {}, "msg");
+        auto *Length = B.CreateCall(MakeLen, {}, "len");
+        auto *End = B.CreateCall(Levels[0], {Message, Length, B.getInt64(0)}, "end");
+        B.CreateRet(B.CreateTrunc(End, B.getInt32Ty()));
+    }
+
+    void generateLevel(unsigned K) {
+        Func = Levels[K];
+        Msg = Func->getArg(0);
+        Len = Func->getArg(1);
+        auto &Ctx = M.getContext();
+        B.SetInsertPoint(BasicBlock::Create(Ctx, "entry", Func));
+        Pos = alloca("pos.addr");
+        B.CreateStore(Func->getArg(2), Pos);
+        Fail = BasicBlock::Create(Ctx, "fail", Func);
+
+        for (unsigned I = 0; I < NumFields; ++I) {
+            auto *V = readField(FieldWidth, "field" + Twine(I));
+            auto *FieldTy = cast<IntegerType>(V->getType());
+            if (I == 0) {
+                // a magic number identifying the level
+                check(B.CreateICmpEQ(V, ConstantInt::get(FieldTy, 0x5A + K)));
+            } else {
+                // a field within a range, e.g., a version or a flag
+                check(B.CreateICmpULT(V, ConstantInt::get(FieldTy, FieldTy->getBitMask() / (I + 1))));
+            }
+        }
+
+        for (unsigned I = 0; I < NumLengthPrefixed; ++I) {
+            Value *N = B.CreateZExt(readField(1, "length" + Twine(I)), I64, "n");
+            if (PayloadLength) {
+                // e.g., a printable string, the remaining payload is skipped
+                check(B.CreateICmpUGE(N, B.getInt64(PayloadLength)));
+                for (unsigned J = 0; J < PayloadLength; ++J)
+                    check(B.CreateICmpULT(readField(1, "payload" + Twine(J)), B.getInt8(0x80)));
+                N = B.CreateSub(N, B.getInt64(PayloadLength), "n.rest");
+            }
+            need(N);
+            advance(N);
+        }
+
+        if (K < Depth) {
+            generateDispatch(K);
+        } else {
+            for (unsigned I = 0; I < NumLoops; ++I) generateTLVLoop();
+        }
+        B.CreateRet(B.CreateLoad(I64, Pos, "end"));
+
+        B.SetInsertPoint(Fail);
+        B.CreateRet(B.getInt64(-1));
+    }
+
+    /// switch (type) { case C: skip C + 1 bytes and parse the next level }
+    void generateDispatch(unsigned K) {
+        auto &Ctx = M.getContext();
+        auto *Type = readField(1, "type");
+        auto *Join = BasicBlock::Create(Ctx, "sw.epilog", Func);
+        auto *Switch = B.CreateSwitch(Type, Fail, NumCases);
+        for (unsigned C = 0; C < NumCases; ++C) {
+            auto *Case = BasicBlock::Create(Ctx, "sw.bb", Func);
+            Switch->addCase(B.getInt8(C), Case);
+            B.SetInsertPoint(Case);
+            need(B.getInt64(C + 1));
+            advance(B.getInt64(C + 1));
+            auto *End = B.CreateCall(Levels[K + 1], {Msg, Len, B.CreateLoad(I64, Pos, "pos")}, "end");
+            check(B.CreateICmpSGE(End, B.getInt64(0)));
+            B.CreateStore(End, Pos);
+            B.CreateBr(Join);
+        }
+        B.SetInsertPoint(Join);
+    }
+
+    /// for (i = 0; i < count; ++i) { type; length; if (type == 0) value must be empty; skip the value }
+    void generateTLVLoop() {
+        auto &Ctx = M.getContext();
+        auto *Count = B.CreateZExt(readField(1, "count"), I64, "count");
+        auto *Idx = alloca("i.addr");
+        B.CreateStore(B.getInt64(0), Idx);
+        auto *Header = BasicBlock::Create(Ctx, "for.cond", Func);
+        auto *Body = BasicBlock::Create(Ctx, "for.body", Func);
+        auto *Exit = BasicBlock::Create(Ctx, "for.end", Func);
+        B.CreateBr(Header);
+
+        B.SetInsertPoint(Header);
+        auto *I = B.CreateLoad(I64, Idx, "i");
+        B.CreateCondBr(B.CreateICmpULT(I, Count), Body, Exit);
+
+        B.SetInsertPoint(Body);
+        auto *Type = readField(1, "tlv.type");
+        auto *L = B.CreateZExt(readField(1, "tlv.length"), I64, "l");
+        check(B.CreateOr(B.CreateICmpNE(Type, B.getInt8(0)), B.CreateICmpEQ(L, B.getInt64(0))));
+        need(L);
+        advance(L);
+        B.CreateStore(B.CreateAdd(B.CreateLoad(I64, Idx, "i"), B.getInt64(1)), Idx);
+        B.CreateBr(Header);
+
+        B.SetInsertPoint(Exit);
+    }
+
+    /// allocas are in the entry block so that mem2reg promotes them
+    Value *alloca(const char *Name) {
+        IRBuilder<> EntryBuilder(&Func->getEntryBlock(), Func->getEntryBlock().begin());
+        return EntryBuilder.CreateAlloca(I64, nullptr, Name);
+    }
+
+    /// continue if the condition holds, otherwise the message is malformed
+    void check(Value *Cond) {
+        auto *Next = BasicBlock::Create(M.getContext(), "if.end", Func);
+        B.CreateCondBr(Cond, Next, Fail);
+        B.SetInsertPoint(Next);
+    }
+
+    /// pos + n <= len
+    void need(Value *N) {
+        auto *P = B.CreateLoad(I64, Pos, "pos");
+        check(B.CreateICmpULE(B.CreateAdd(P, N), Len));
+    }
+
+    void advance(Value *N) {
+        B.CreateStore(B.CreateAdd(B.CreateLoad(I64, Pos, "pos"), N), Pos);
+    }
+
+    /// read a big-endian field of the width in bytes byte by byte, as protocol parsers usually do
+    Value *readField(unsigned Width, const Twine &Name) {
+        need(B.getInt64(Width));
+        auto *P = B.CreateLoad(I64, Pos, "pos");
+        auto *FieldTy = B.getIntNTy(Width * 8);
+        Value *V = nullptr;
+        for (unsigned I = 0; I < Width; ++I) {
+            auto *Addr = B.CreateGEP(I8, Msg, B.CreateAdd(P, B.getInt64(I)), "arrayidx");
+            Value *Byte = B.CreateLoad(I8, Addr, "byte");
+            if (Width == 1) {
+                V = Byte;
+                break;
+            }
+            Byte = B.CreateZExt(Byte, FieldTy);
+            V = V ? B.CreateOr(B.CreateShl(V, 8), Byte) : Byte;
+        }
+        V->setName(Name);
+        advance(B.getInt64(Width));
+        return V;
+    }
+};
+}
+
+int main(int argc, char **argv) {
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "Generate the bitcode of a synthetic protocol parser for Popeye\n");
+    if (FieldWidth != 1 && FieldWidth != 2 && FieldWidth != 4 && FieldWidth != 8) {
+        errs() << argv[0] << ": error: -field-width should be 1, 2, 4, or 8\n";
+        return 1;
+    }
+    if (PayloadLength > 255) {
+        errs() << argv[0] << ": error: -payload-length should be at most 255, the largest 1-byte length\n";
+        return 1;
+    }
+    if (NumCases > 256) {
+        errs() << argv[0] << ": error: -switch-cases should be at most 256\n";
+        return 1;
+    }
+
+    LLVMContext Context;
+    Module M("popeye-gen", Context);
+    M.setDataLayout("e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128");
+    M.setTargetTriple("x86_64-unknown-linux-gnu");
+    ParserGenerator(M).generate();
+    if (verifyModule(M, &errs())) {
+        errs() << argv[0] << ": error: generated module is broken!\n";
+        return 1;
+    }
+
+    std::error_code EC;
+    ToolOutputFile Out(OutputFilename.getValue(), EC, sys::fs::OF_None);
+    if (EC) {
+        errs() << EC.message() << '\n';
+        return 1;
+    }
+    if (OutputAssembly) {
+        M.print(Out.os(), nullptr);
+    } else {
+        WriteBitcodeToFile(M, Out.os());
+    }
+    Out.keep();
+    return 0;
+}
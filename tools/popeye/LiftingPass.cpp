@@ -28,6 +28,7 @@
 #include "Core/Executor.h"
 #include "Core/FSM.h"
 #include "Core/LoopInformationAnalysis.h"
+#include "Core/MessageTaintAnalysis.h"
 #include "Core/PLang.h"
 #include "Core/DDLLang.h"
 #include "Core/SliceGraph.h"
@@ -36,6 +37,7 @@
 #include "LiftingPass.h"
 #include "Support/Debug.h"
 #include "Support/DL.h"
+#include "Support/Profiler.h"
 #include "Support/TimeRecorder.h"
 #include "Support/Z3.h"
 
@@ -54,16 +56,24 @@ static cl::list<std::string> EnableOutputs("popeye-output",
 char LiftingPass::ID = 0;
 static RegisterPass<LiftingPass> X(DEBUG_TYPE, "The core engine of Popeye.");
 
+static int64_t treeSize(SymbolicExecutionTree *Tree) {
+    int64_t Size = 0;
+    Tree->dfs([&Size](SymbolicExecutionTreeNode *) { ++Size; });
+    return Size;
+}
+
 void LiftingPass::getAnalysisUsage(AnalysisUsage &AU) const {
     AU.setPreservesAll();
     AU.addRequired<LoopInformationAnalysis>();
     AU.addRequired<DomInformationAnalysis>();
     AU.addRequired<DistinctMetadataAnalysis>();
+    AU.addRequired<MessageTaintAnalysis>();
 }
 
 bool LiftingPass::runOnModule(Module &M) {
     DL::initialize(M.getDataLayout());
     Z3::initialize();
+    Profiler::initialize();
 
     checkBuiltInFunctions(M);
     auto *Entry = M.getFunction(EntryFunctionName.getValue());
@@ -120,12 +130,16 @@ bool LiftingPass::runOnModule(Module &M) {
         TimeRecorder SETimer("Step 2: Executing on the slice");
         SliceGraph *Slice = SliceGraph::get(PC);
         assert(Slice);
+        Profiler::counter("slice.initial", Slice->size());
         if (!OutputDotFile.empty()) Slice->dot(OutputDotFile, "graph");
         Slice->simplifyBeforeSymbolicExecution();
+        Profiler::counter("slice.simplified", Slice->size());
         if (!OutputDotFile.empty()) Slice->dot(OutputDotFile, "graph.simplify");
         SymbolicExecutionTree *Tree = SymbolicExecution().run(PC, *Slice);
         delete Slice;
+        if (Profiler::enabled()) Profiler::counter("tree.initial", treeSize(Tree));
         Tree->simplify();
+        if (Profiler::enabled()) Profiler::counter("tree.simplified", treeSize(Tree));
         if (!OutputDotFile.empty()) Tree->dot(OutputDotFile, "tree");
         PC = Tree->pc();
         delete Tree;
@@ -137,6 +151,7 @@ bool LiftingPass::runOnModule(Module &M) {
         assert(PhiVec.empty());
         auto *NewSlice = SliceGraph::get(PC, true);
         NewSlice->simplifyAfterSymbolicExecution();
+        Profiler::counter("slice.final", NewSlice->size());
         if (!OutputDotFile.empty()) NewSlice->dot(OutputDotFile, "final");
         if (!OutputBNFFile.empty()) BNF(NewSlice->pc()).dump(OutputBNFFile);
         if (!OutputFSMFile.empty()) FSM(NewSlice).dump(OutputFSMFile);
@@ -155,6 +170,8 @@ bool LiftingPass::runOnModule(Module &M) {
         delete NewSlice;
     }
 
+    Z3::statistics();
+    Profiler::finalize();
     DL::finalize();
     Z3::finalize();
     return false;